@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Summarize a heap dump written by heap_dump() or --heap-dump-signal.
+
+Computes the dominator tree of the object graph, then reports the objects
+and roots that retain the most memory, with the path that keeps each one
+alive. An object's retained size is what a collection would free if the
+object became unreachable.
+
+Usage: analyze_heap.py <dump.json> [--top N]
+"""
+import argparse
+import json
+import sys
+
+ROOT = 0  # A virtual node that references every root.
+
+
+def load(path):
+    with open(path, encoding="utf-8") as file:
+        dump = json.load(file)
+    objects = {obj["id"]: obj for obj in dump["objects"]}
+    roots = [root for root in dump["roots"] if root["id"] in objects]
+    return dump, objects, roots
+
+
+def reverse_postorder(objects, roots):
+    """Walk the graph from the virtual root without recursion."""
+    successors = {ROOT: [root["id"] for root in roots]}
+    for obj in objects.values():
+        successors[obj["id"]] = [ref for ref in obj["refs"] if ref in objects]
+
+    order = []
+    visited = {ROOT}
+    stack = [(ROOT, iter(successors[ROOT]))]
+    while stack:
+        node, children = stack[-1]
+        for child in children:
+            if child not in visited:
+                visited.add(child)
+                stack.append((child, iter(successors[child])))
+                break
+        else:
+            stack.pop()
+            order.append(node)
+    order.reverse()
+    return order, successors
+
+
+def dominators(order, successors):
+    """The iterative algorithm of Cooper, Harvey and Kennedy."""
+    index = {node: i for i, node in enumerate(order)}
+    predecessors = {node: [] for node in order}
+    for node in order:
+        for child in successors[node]:
+            if child in index:
+                predecessors[child].append(node)
+
+    idom = {ROOT: ROOT}
+
+    def intersect(a, b):
+        while a != b:
+            while index[a] > index[b]:
+                a = idom[a]
+            while index[b] > index[a]:
+                b = idom[b]
+        return a
+
+    changed = True
+    while changed:
+        changed = False
+        for node in order[1:]:
+            new_idom = None
+            for pred in predecessors[node]:
+                if pred in idom:
+                    new_idom = pred if new_idom is None else intersect(
+                        pred, new_idom)
+            if idom.get(node) != new_idom:
+                idom[node] = new_idom
+                changed = True
+    return idom
+
+
+def retained_sizes(order, idom, objects):
+    retained = {node: objects[node]["size"] for node in order if node != ROOT}
+    retained[ROOT] = 0
+    for node in reversed(order[1:]):
+        retained[idom[node]] += retained[node]
+    return retained
+
+
+def describe(obj):
+    label = obj["label"]
+    return f'{obj["type"]} "{label}"' if label else obj["type"]
+
+
+def path_to(node, order, successors, roots, objects):
+    """The shortest chain of references from a root to the node."""
+    parent = {root["id"]: root for root in roots}
+    queue = [root["id"] for root in roots]
+    for current in queue:
+        if current == node:
+            break
+        for child in successors[current]:
+            if child not in parent:
+                parent[child] = current
+                queue.append(child)
+
+    chain = []
+    while isinstance(parent.get(node), int):
+        chain.append(describe(objects[node]))
+        node = parent[node]
+    chain.append(describe(objects[node]))
+    root = parent[node]
+    name = f' {root["name"]}' if root["name"] else ""
+    chain.append(f'{root["kind"]}{name}')
+    return " <- ".join(chain)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="the heap dump to read")
+    parser.add_argument("--top", type=int, default=10,
+                        help="how many entries to list (default 10)")
+    args = parser.parse_args()
+
+    dump, objects, roots = load(args.dump)
+    order, successors = reverse_postorder(objects, roots)
+    idom = dominators(order, successors)
+    retained = retained_sizes(order, idom, objects)
+
+    reachable = [node for node in order if node != ROOT]
+    live_bytes = sum(objects[node]["size"] for node in reachable)
+    total_bytes = sum(obj["size"] for obj in objects.values())
+    print(f"heap: {dump['bytes']} bytes allocated")
+    print(f"objects: {len(objects)} ({total_bytes} bytes), "
+          f"{len(reachable)} reachable ({live_bytes} bytes)")
+
+    by_type = {}
+    for node in reachable:
+        obj = objects[node]
+        count, size = by_type.get(obj["type"], (0, 0))
+        by_type[obj["type"]] = (count + 1, size + obj["size"])
+    print("\nreachable objects by type:")
+    for kind, (count, size) in sorted(
+            by_type.items(), key=lambda item: -item[1][1]):
+        print(f"  {kind:<14} {count:>10} {size:>12}")
+
+    print("\nroots by retained size:")
+    root_ids = sorted({root["id"] for root in roots if idom[root["id"]] == ROOT},
+                      key=lambda node: -retained[node])
+    names = {}
+    for root in roots:
+        names.setdefault(root["id"], root)
+    for node in root_ids[:args.top]:
+        root = names[node]
+        name = f' {root["name"]}' if root["name"] else ""
+        print(f"  {retained[node]:>12}  {root['kind']}{name}: "
+              f"{describe(objects[node])}")
+
+    print("\nobjects by retained size:")
+    for node in sorted(reachable, key=lambda node: -retained[node])[:args.top]:
+        print(f"  {retained[node]:>12}  "
+              f"{path_to(node, order, successors, roots, objects)}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
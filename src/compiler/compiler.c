@@ -100,6 +100,13 @@ ClassCompiler* current_class = NULL;
 /// The currently compiling bytecode segment.
 Bytecode* compiling_bytecode;
 
+/// The source being compiled.
+static const char* source_start = NULL;
+
+/// The heap string that holds the source, which long string literals are
+/// slices of, or NULL when the source is not in the heap.
+static ObjString* source_string = NULL;
+
 static void
 error_at(const Token* token, const char* message) {
     if (parser.panic_mode)
@@ -206,6 +213,7 @@ emit_jump(uint16_t instruction) {
 static uint16_t
 make_constant(Value value) {
     int constant = write_constant(current_bytecode(), value);
+    write_barrier((Obj*)current->function, value);
     if (constant > UINT16_MAX) {
         error("Too many constants in one bytecode array.");
         return 0;
@@ -243,8 +251,10 @@ init_compiler(Compiler* compiler, FunctionType type) {
     current = compiler;
 
     if (type != TYPE_SCRIPT) {
-        current->function->name =
+        ObjString* name =
             copy_string(parser.previous.start, parser.previous.length);
+        current->function->name = TO_REF(name);
+        write_barrier((Obj*)current->function, OBJ_VAL(name));
     }
 
     Local* local = &current->locals[current->local_count++];
@@ -278,7 +288,9 @@ end_compiler() {
     if (!parser.had_error) {
         disassemble_bytecode(
             current_bytecode(),
-            function->name != NULL ? function->name->chars : "<script>");
+            function->name != TO_REF((ObjString*)NULL)
+                ? DEREF(ObjString, function->name)->chars
+                : "<script>");
     }
 #endif
 
@@ -859,8 +871,15 @@ or_(bool can_assign) {
 
 static void
 string(bool can_assign) {
-    emit_constant(OBJ_VAL(
-        copy_string(parser.previous.start + 1, parser.previous.length - 2)));
+    const char* chars = parser.previous.start + 1;
+    int         length = parser.previous.length - 2;
+    if (length < SLICE_MIN_LENGTH || source_string == NULL) {
+        emit_constant(OBJ_VAL(copy_string(chars, length)));
+        return;
+    }
+
+    int start = (int)(chars - source_start);
+    emit_constant(OBJ_VAL(new_slice((Obj*)source_string, start, length)));
 }
 
 static void
@@ -1085,8 +1104,10 @@ get_rule(TokenType type) {
 }
 
 ObjFunction*
-compile(const char* source) {
+compile(const char* source, ObjString* owner) {
     init_scanner(source);
+    source_start = source;
+    source_string = owner;
     Compiler compiler;
     init_compiler(&compiler, TYPE_SCRIPT);
 
@@ -1100,14 +1121,27 @@ compile(const char* source) {
     }
 
     ObjFunction* func = end_compiler();
+    source_string = NULL;
     return parser.had_error ? NULL : func;
 }
 
 void
 mark_compiler_roots() {
+    mark_object((Obj*)source_string);
     Compiler* compiler = current;
     while (compiler != NULL) {
         mark_object((Obj*)compiler->function);
         compiler = compiler->enclosing;
     }
+}
+
+void
+forward_compiler_roots() {
+    source_string = (ObjString*)forward_object((Obj*)source_string);
+    Compiler* compiler = current;
+    while (compiler != NULL) {
+        compiler->function =
+            (ObjFunction*)forward_object((Obj*)compiler->function);
+        compiler = compiler->enclosing;
+    }
 }
\ No newline at end of file
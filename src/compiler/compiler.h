@@ -12,12 +12,18 @@
 ///
 /// Params:
 /// - source: The source code.
+/// - owner: The heap string that holds the source, or NULL. Long string
+///   literals are slices of it rather than copies.
 ///
 /// Returns:
 /// - ObjFunction*: The compiled function.
 ObjFunction*
-compile(const char* source);
+compile(const char* source, ObjString* owner);
 
 /// Mark roots in the compiler code for GC.
 void
-mark_compiler_roots();
\ No newline at end of file
+mark_compiler_roots();
+
+/// Update roots in the compiler code to objects moved by a compaction.
+void
+forward_compiler_roots();
\ No newline at end of file
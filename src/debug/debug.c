@@ -7,34 +7,34 @@
 #include "bytecode.h"
 
 #include <object.h>
-#include <stdio.h>
+#include <output.h>
 
 static int
 simple_instruction(const char* name, int offset) {
-    printf("%s\n", name);
+    output_format("%s\n", name);
     return offset + 1;
 }
 
 static int
 word_instruction(const char* name, Bytecode* bytecode, int offset) {
     uint16_t slot = bytecode->code[offset + 1];
-    printf("%-16s %4d\n", name, slot);
+    output_format("%-16s %4d\n", name, slot);
     return offset + 2;
 }
 
 static int
 jump_instruction(const char* name, int sign, Bytecode* bytecode, int offset) {
     uint16_t jump = bytecode->code[offset + 1];
-    printf("%-16s %4d -> %d\n", name, offset, offset + 2 + sign * jump);
+    output_format("%-16s %4d -> %d\n", name, offset, offset + 2 + sign * jump);
     return offset + 2;
 }
 
 static int
 constant_instruction(const char* name, Bytecode* bytecode, int offset) {
     uint16_t constant = bytecode->code[offset + 1];
-    printf("%-16s %4d '", name, constant);
+    output_format("%-16s %4d '", name, constant);
     print_value(bytecode->constants.values[constant]);
-    printf("'\n");
+    output_format("'\n");
     return offset + 2;
 }
 
@@ -42,15 +42,15 @@ static int
 invoke_instruction(const char* name, Bytecode* bytecode, int offset) {
     uint16_t constant = bytecode->code[offset + 1];
     uint16_t arg_count = bytecode->code[offset + 2];
-    printf("%-16s (%d args) %4d '", name, arg_count, constant);
+    output_format("%-16s (%d args) %4d '", name, arg_count, constant);
     print_value(bytecode->constants.values[constant]);
-    printf("'\n");
+    output_format("'\n");
     return offset + 3;
 }
 
 void
 disassemble_bytecode(Bytecode* bytecode, const char* name) {
-    printf("== %s ==\n", name);
+    output_format("== %s ==\n", name);
 
     for (int offset = 0; offset < bytecode->count;) {
         offset = disassemble_instruction(bytecode, offset);
@@ -59,11 +59,11 @@ disassemble_bytecode(Bytecode* bytecode, const char* name) {
 
 int
 disassemble_instruction(Bytecode* bytecode, int offset) {
-    printf("%04d ", offset);
+    output_format("%04d ", offset);
     if (offset > 0 && bytecode->lines[offset] == bytecode->lines[offset - 1]) {
-        printf("   | ");
+        output_format("   | ");
     } else {
-        printf("%4d ", bytecode->lines[offset]);
+        output_format("%4d ", bytecode->lines[offset]);
     }
     uint16_t instruction = bytecode->code[offset];
     switch (instruction) {
@@ -134,16 +134,16 @@ disassemble_instruction(Bytecode* bytecode, int offset) {
         case OP_CLOSURE: {
             offset++;
             uint16_t constant = bytecode->code[offset++];
-            printf("%-16s %4d ", "OP_CLOSURE", constant);
+            output_format("%-16s %4d ", "OP_CLOSURE", constant);
             print_value(bytecode->constants.values[constant]);
-            printf("\n");
+            output_format("\n");
 
             ObjFunction* function =
                 AS_FUNCTION(bytecode->constants.values[constant]);
             for (int j = 0; j < function->upvalue_count; j++) {
                 int is_local = bytecode->code[offset++];
                 int index = bytecode->code[offset++];
-                printf(
+                output_format(
                     "%04d      |                     %s %d\n",
                     offset - 2,
                     is_local ? "local" : "upvalue",
@@ -161,7 +161,7 @@ disassemble_instruction(Bytecode* bytecode, int offset) {
         case OP_RETURN:
             return simple_instruction("OP_RETURN", offset);
         default:
-            printf("Unknown opcode %d\n", instruction);
+            output_format("Unknown opcode %d\n", instruction);
             return offset + 1;
     }
 }
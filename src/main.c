@@ -3,12 +3,40 @@
 // Author:  Jake Hathaway
 // Date:    2025-08-17
 #include "common.h"
+#include "memory/arena.h"
+#include "memory/heap_dump.h"
 #include "memory/memory.h"
+#include "memory/profile.h"
+#include "runtime/output.h"
 #include "runtime/vm.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Set by --gc-stats to print the gc statistics once the program ends.
+static bool report_gc_stats = false;
+
+// Set by --alloc-profile to the file the allocation profile is written to.
+static const char* profile_path = NULL;
+
+// Set by --alloc-sample to the bytes allocated between two samples.
+static size_t profile_interval = PROFILE_DEFAULT_INTERVAL;
+
+// Set by --output-buffer to the size of the buffer for standard out.
+static size_t output_buffer_size = OUTPUT_DEFAULT_BUFFER_SIZE;
+
+/// Print and write the reports asked for on the command line.
+static void
+write_reports(void) {
+    if (report_gc_stats) {
+        report_memory_statistics();
+    }
+    if (profile_path != NULL && !profile_write(profile_path)) {
+        fprintf(stderr, "Could not write profile \"%s\".\n", profile_path);
+    }
+}
+
 static void
 repl(void) {
     char line[1024];
@@ -34,11 +62,12 @@ repl(void) {
         }
 
         interpret(line);
+        output_flush();
     }
 }
 
-static char*
-read_file(const char* path, size_t* out_size) {
+static ObjString*
+read_file(const char* path) {
     FILE* file = fopen(path, "rb");
     if (file == NULL) {
         fprintf(stderr, "Could not open file \"%s\".\n", path);
@@ -49,31 +78,30 @@ read_file(const char* path, size_t* out_size) {
     size_t file_size = ftell(file);
     rewind(file);
 
-    char* buffer = ALLOCATE(char, file_size + 1); // Fixed: was 'length + 1'
-    if (buffer == NULL) {
-        fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
+    if (file_size > INT_MAX) {
+        fprintf(stderr, "File \"%s\" is too large.\n", path);
         exit(74);
     }
 
-    size_t bytes_read = fread(buffer, sizeof(char), file_size, file);
+    // The source is read into the heap, so the string literals in it can be
+    // slices of it. Arena mode drops it with the rest of the heap.
+    ObjString* source = reserve_string((int)file_size);
+    size_t     bytes_read = fread(source->chars, sizeof(char), file_size, file);
     if (bytes_read < file_size) {
         fprintf(stderr, "Could not read file \"%s\".\n", path);
         exit(74);
     }
 
-    buffer[bytes_read] = '\0';
     fclose(file);
-    *out_size = file_size + 1;
-    return buffer;
+    return source;
 }
 
 static void
 run_file(const char* path) {
-    size_t          size;
-    char*           source = read_file(path, &size);
-    InterpretResult result = interpret(source);
+    InterpretResult result = interpret_string(read_file(path));
 
-    FREE_ARRAY(char, source, size);
+    output_flush();
+    write_reports();
 
     if (result == INTERPRET_COMPILE_ERROR) {
         exit(65);
@@ -83,19 +111,200 @@ run_file(const char* path) {
     }
 }
 
+static void
+usage(void) {
+    fprintf(stderr, "Usage: sigil [options] [path]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --gc-incremental       Mark the heap in slices.\n");
+    fprintf(stderr, "  --gc-max-pause-us=<n>  Bound each mark slice.\n");
+    fprintf(stderr, "  --gc-concurrent        Mark on a helper thread.\n");
+    fprintf(stderr, "  --gc-threads=<n>       Mark and sweep on n threads.\n");
+    fprintf(stderr, "  --gc-lazy-sweep        Sweep while the program runs.\n");
+    fprintf(stderr, "  --gc-compact           Compact a fragmented heap.\n");
+    fprintf(stderr, "  --gc-headroom=<n>      Spare pages kept, in %%.\n");
+    fprintf(stderr, "  --gc-cpu-percent=<n>   Target n%% of time in gc.\n");
+    fprintf(stderr, "  --gc-min-heap=<size>   Never collect a smaller heap.\n");
+    fprintf(stderr, "  --gc-max-heap=<size>   Start gc by this heap size.\n");
+    fprintf(stderr, "  --gc-heap-limit=<size> Fail allocations past this.\n");
+    fprintf(stderr, "  --gc-stats             Report gc statistics at exit.\n");
+    fprintf(stderr, "  --arena                Drop the whole heap at exit.\n");
+    fprintf(stderr, "  --arena-budget=<size>  Start gc by this heap size.\n");
+    fprintf(stderr, "  --alloc-profile=<path> Write allocation sites.\n");
+    fprintf(stderr, "  --alloc-sample=<size>  Sample every size bytes.\n");
+    fprintf(stderr, "  --output-buffer=<size> Buffer this much output.\n");
+    fprintf(stderr, "  --heap-dump-signal=<path>\n");
+    fprintf(stderr, "                         Dump the heap on SIGUSR1.\n");
+    fprintf(stderr, "Sizes are in bytes and may end in K, M or G.\n");
+    fprintf(stderr, "The environment variables SIGIL_GC_CPU_PERCENT,\n");
+    fprintf(stderr, "SIGIL_GC_MIN_HEAP, SIGIL_GC_MAX_HEAP and\n");
+    fprintf(stderr, "SIGIL_GC_HEAP_LIMIT set the same.\n");
+    exit(64);
+}
+
+/// Get the value of an option written as --name=value.
+///
+/// Params:
+/// - arg: The command line argument.
+/// - name: The option name, including the leading dashes.
+///
+/// Returns:
+/// - const char*: The text after the '=', or NULL when arg is not the option.
+static const char*
+option_value(const char* arg, const char* name) {
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=') {
+        return NULL;
+    }
+    return arg + length + 1;
+}
+
+static uint64_t
+parse_count(const char* text) {
+    char*              end;
+    unsigned long long count = strtoull(text, &end, 10);
+    if (end == text || *end != '\0') {
+        usage();
+    }
+    return (uint64_t)count;
+}
+
+/// Parse a size in bytes, optionally followed by K, M or G.
+static size_t
+parse_size(const char* text) {
+    char*              end;
+    unsigned long long size = strtoull(text, &end, 10);
+    if (end == text) {
+        usage();
+    }
+
+    switch (*end) {
+        case 'G': size *= 1024; // Fall through.
+        case 'M': size *= 1024; // Fall through.
+        case 'K':
+            size *= 1024;
+            end++;
+            break;
+    }
+
+    if (*end != '\0') {
+        usage();
+    }
+    return (size_t)size;
+}
+
+static uint64_t
+parse_cpu_percent(const char* text) {
+    uint64_t percent = parse_count(text);
+    if (percent < 1 || percent > 99) {
+        usage();
+    }
+    return percent;
+}
+
+/// Read the gc settings that can come from the environment. Options on the
+/// command line take precedence.
+static void
+read_environment(void) {
+    const char* value;
+
+    if ((value = getenv("SIGIL_GC_CPU_PERCENT")) != NULL) {
+        vm.gc_config.cpu_percent = parse_cpu_percent(value);
+    }
+    if ((value = getenv("SIGIL_GC_MIN_HEAP")) != NULL) {
+        vm.gc_config.min_heap = parse_size(value);
+    }
+    if ((value = getenv("SIGIL_GC_MAX_HEAP")) != NULL) {
+        vm.gc_config.max_heap = parse_size(value);
+    }
+    if ((value = getenv("SIGIL_GC_HEAP_LIMIT")) != NULL) {
+        vm.gc_config.heap_limit = parse_size(value);
+    }
+}
+
+static void
+parse_option(const char* arg) {
+    const char* value;
+
+    if (strcmp(arg, "--gc-incremental") == 0) {
+        vm.gc_config.incremental = true;
+    } else if (strcmp(arg, "--gc-concurrent") == 0) {
+        vm.gc_config.concurrent = true;
+    } else if (strcmp(arg, "--gc-lazy-sweep") == 0) {
+        vm.gc_config.lazy_sweep = true;
+    } else if (strcmp(arg, "--gc-compact") == 0) {
+        vm.gc_config.compact = true;
+    } else if ((value = option_value(arg, "--gc-max-pause-us")) != NULL) {
+        vm.gc_config.incremental = true;
+        vm.gc_config.max_pause_us = parse_count(value);
+    } else if ((value = option_value(arg, "--gc-threads")) != NULL) {
+        uint64_t threads = parse_count(value);
+        if (threads < 1 || threads > GC_MAX_THREADS) {
+            usage();
+        }
+        vm.gc_config.threads = (int)threads;
+    } else if ((value = option_value(arg, "--gc-headroom")) != NULL) {
+        vm.gc_config.headroom_percent = parse_count(value);
+    } else if ((value = option_value(arg, "--gc-cpu-percent")) != NULL) {
+        vm.gc_config.cpu_percent = parse_cpu_percent(value);
+    } else if ((value = option_value(arg, "--gc-min-heap")) != NULL) {
+        vm.gc_config.min_heap = parse_size(value);
+    } else if ((value = option_value(arg, "--gc-max-heap")) != NULL) {
+        vm.gc_config.max_heap = parse_size(value);
+    } else if ((value = option_value(arg, "--gc-heap-limit")) != NULL) {
+        vm.gc_config.heap_limit = parse_size(value);
+    } else if (strcmp(arg, "--arena") == 0) {
+        vm.gc_config.arena = true;
+    } else if ((value = option_value(arg, "--arena-budget")) != NULL) {
+        vm.gc_config.arena = true;
+        vm.gc_config.arena_budget = parse_size(value);
+    } else if (strcmp(arg, "--gc-stats") == 0) {
+        report_gc_stats = true;
+    } else if ((value = option_value(arg, "--alloc-profile")) != NULL) {
+        profile_path = value;
+    } else if ((value = option_value(arg, "--alloc-sample")) != NULL) {
+        profile_interval = parse_size(value);
+    } else if ((value = option_value(arg, "--output-buffer")) != NULL) {
+        output_buffer_size = parse_size(value);
+    } else if ((value = option_value(arg, "--heap-dump-signal")) != NULL) {
+        heap_dump_on_signal(value);
+    } else {
+        usage();
+    }
+}
+
 int
 main(int argc, const char* argv[]) {
     init_vm();
+    read_environment();
+
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) == 0) {
+            parse_option(argv[i]);
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            usage();
+        }
+    }
+    apply_gc_config();
+    init_output(output_buffer_size);
+    if (profile_path != NULL) {
+        profile_start(profile_interval);
+    }
 
-    if (argc == 1) {
+    if (path == NULL) {
+        if (vm.gc_config.arena) {
+            // Each line would lose the globals of the ones before it.
+            usage();
+        }
         repl();
-    } else if (argc == 2) {
-        run_file(argv[1]);
+        write_reports();
     } else {
-        fprintf(stderr, "Usage: sigil [path]\n");
-        exit(64);
+        run_file(path);
     }
 
+    free_output();
     free_vm();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+// File:    arena.c
+// Purpose: Implement arena.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "arena.h"
+#include "large.h"
+#include <stdint.h>
+#include <string.h>
+
+// The alignment of every block, which is what malloc guarantees.
+#define ARENA_ALIGN 16
+
+/// A chunk of the arena. Blocks follow the header.
+typedef struct ArenaChunk {
+    struct ArenaChunk* next; // The chunk mapped before this one.
+    size_t             size; // The size in bytes the chunk was mapped with.
+    char*              top;  // The start of the unused part of the chunk.
+    char*              last; // The last block handed out, or NULL.
+    char*              end;  // The end of the chunk.
+} ArenaChunk;
+
+// The chunks, newest first. Blocks are only taken from the newest one.
+static ArenaChunk* chunks = NULL;
+
+static size_t
+align_size(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static char*
+chunk_start(ArenaChunk* chunk) {
+    return (char*)chunk + align_size(sizeof(ArenaChunk));
+}
+
+static ArenaChunk*
+new_chunk(size_t size) {
+    size_t mapped = align_size(sizeof(ArenaChunk)) + size;
+    if (mapped < ARENA_CHUNK_SIZE) {
+        mapped = ARENA_CHUNK_SIZE;
+    }
+
+    ArenaChunk* chunk = (ArenaChunk*)large_map(mapped, 0);
+    if (chunk == NULL)
+        return NULL;
+
+    chunk->next = chunks;
+    chunk->size = mapped;
+    chunk->top = chunk_start(chunk);
+    chunk->last = NULL;
+    chunk->end = (char*)chunk + mapped;
+    chunks = chunk;
+    return chunk;
+}
+
+void*
+arena_allocate(size_t size) {
+    size = align_size(size);
+
+    ArenaChunk* chunk = chunks;
+    if (chunk == NULL || (size_t)(chunk->end - chunk->top) < size) {
+        chunk = new_chunk(size);
+        if (chunk == NULL)
+            return NULL;
+    }
+
+    chunk->last = chunk->top;
+    chunk->top += size;
+    return chunk->last;
+}
+
+void*
+arena_resize(void* pointer, size_t old_size, size_t new_size) {
+    ArenaChunk* chunk = chunks;
+    if (pointer != NULL && chunk != NULL && pointer == chunk->last
+        && (size_t)(chunk->end - chunk->last) >= new_size) {
+        // Growing the last block only moves the top of the chunk.
+        chunk->top = chunk->last + align_size(new_size);
+        return pointer;
+    }
+
+    void* result = arena_allocate(new_size);
+    if (result != NULL && pointer != NULL) {
+        memcpy(result, pointer, old_size < new_size ? old_size : new_size);
+    }
+    return result;
+}
+
+bool
+arena_contains(const void* pointer) {
+    for (ArenaChunk* chunk = chunks; chunk != NULL; chunk = chunk->next) {
+        if ((const char*)pointer >= chunk_start(chunk)
+            && (const char*)pointer < chunk->end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+arena_reset(void) {
+    // The oldest chunk is kept when it has the usual size, so a process that
+    // runs many short scripts maps nothing once the first one is done.
+    while (chunks != NULL
+           && (chunks->next != NULL || chunks->size != ARENA_CHUNK_SIZE)) {
+        ArenaChunk* chunk = chunks;
+        chunks = chunk->next;
+        large_unmap(chunk, chunk->size);
+    }
+
+    if (chunks != NULL) {
+        chunks->top = chunk_start(chunks);
+        chunks->last = NULL;
+    }
+}
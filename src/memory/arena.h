@@ -0,0 +1,57 @@
+// File:    arena.h
+// Purpose: Definitions for the arena, which hands out the buffers of a
+//          short run from big chunks and drops them all at once.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The size of the chunks the arena maps. Bigger blocks get a chunk of
+// their own.
+#define ARENA_CHUNK_SIZE (1024 * 1024)
+
+// The default heap size an arena run may reach before the first collection.
+#define ARENA_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+/// Allocate a block by bumping the top of the current chunk.
+///
+/// Params:
+/// - size: The size in bytes of the block.
+///
+/// Returns:
+/// - void*: The block, aligned to 16 bytes, or NULL when the system is out
+///   of memory.
+void*
+arena_allocate(size_t size);
+
+/// Change the size of a block. The last block of a chunk grows or shrinks
+/// in place when the chunk has room, and any other block is copied.
+///
+/// Params:
+/// - pointer: A block returned by the arena, or NULL.
+/// - old_size: The size in bytes of the block.
+/// - new_size: The size in bytes the block should have.
+///
+/// Returns:
+/// - void*: The block, which may have moved, or NULL when the system is out
+///   of memory.
+void*
+arena_resize(void* pointer, size_t old_size, size_t new_size);
+
+/// Check whether a block came from the arena.
+///
+/// Params:
+/// - pointer: The block to check.
+///
+/// Returns:
+/// - bool: True when the block lies in one of the arena's chunks.
+bool
+arena_contains(const void* pointer);
+
+/// Drop every block at once. The first chunk is kept for the next run and
+/// the others go back to the system.
+void
+arena_reset(void);
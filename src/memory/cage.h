@@ -0,0 +1,52 @@
+// File:    cage.h
+// Purpose: Define how heap objects refer to each other.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A reference from one heap object to another is declared as REF(type).
+// By default it is a plain pointer. When built with HEAP_CAGE, every object
+// lives in a single reserved region of HEAP_CAGE_SIZE bytes and a reference
+// is a 32-bit offset into it, which halves the size of pointer fields.
+// TO_REF converts a pointer to a reference, and DEREF converts it back.
+
+#ifdef HEAP_CAGE
+
+// The size of the reserved region that holds every heap object.
+#define HEAP_CAGE_SIZE ((size_t)1 << 32)
+
+#define REF(type) uint32_t
+
+#define TO_REF(pointer) heap_cage_encode(pointer)
+
+#define DEREF(type, ref) ((type*)heap_cage_decode(ref))
+
+// The start of the heap cage. Offset 0 holds a page header, never an object,
+// so it stands for NULL.
+extern char* heap_cage_base;
+
+static inline uint32_t
+heap_cage_encode(const void* pointer) {
+    if (pointer == NULL)
+        return 0;
+    return (uint32_t)((const char*)pointer - heap_cage_base);
+}
+
+static inline void*
+heap_cage_decode(uint32_t ref) {
+    return ref == 0 ? NULL : heap_cage_base + ref;
+}
+
+#else
+
+#define REF(type) type*
+
+#define TO_REF(pointer) (pointer)
+
+#define DEREF(type, ref) (ref)
+
+#endif
@@ -0,0 +1,372 @@
+// File:    heap_dump.c
+// Purpose: Implement heap_dump.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "heap_dump.h"
+#include "memory.h"
+#include "object.h"
+#include "vm.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The most characters of a string written as its label.
+#define HEAP_DUMP_MAX_LABEL 40
+
+volatile sig_atomic_t heap_dump_requested = 0;
+
+// The start of the file names for dumps asked for by a signal.
+static const char* signal_path = NULL;
+
+// The number of dumps asked for by a signal so far.
+static int signal_count = 0;
+
+// The file being written.
+static FILE* out = NULL;
+
+// Set once an object is written, so the next one is preceded by a comma.
+static bool wrote_object = false;
+
+// Set once a reference of the current object is written, so the next one
+// is preceded by a comma.
+static bool wrote_ref = false;
+
+static uintptr_t
+object_id(Obj* object) {
+    return (uintptr_t)object;
+}
+
+/// Write a string as a JSON string. Bytes outside of printable ASCII are
+/// escaped one by one, which keeps the file valid whatever the encoding.
+///
+/// Params:
+/// - chars: The characters to write.
+/// - length: The number of characters.
+static void
+write_json_string(const char* chars, int length) {
+    fputc('"', out);
+    for (int i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void
+write_label(const ObjString* string) {
+    if (string == NULL) {
+        fputs("\"\"", out);
+        return;
+    }
+
+    int length = string->length;
+    if (length > HEAP_DUMP_MAX_LABEL) {
+        length = HEAP_DUMP_MAX_LABEL;
+    }
+    write_json_string(string->chars, length);
+}
+
+static void
+write_root(const char* kind, const ObjString* name, Value value) {
+    if (!IS_OBJ(value) || AS_OBJ(value) == NULL)
+        return;
+
+    fprintf(out, ",\n{\"kind\":\"%s\",\"name\":", kind);
+    write_label(name);
+    fprintf(out, ",\"id\":%" PRIuPTR "}", object_id(AS_OBJ(value)));
+}
+
+/// Write the roots that mark_roots scans. The compiler roots are left out:
+/// dumps are taken while a script runs, when nothing is being compiled.
+static void
+write_roots() {
+    fputs("\"roots\":[\n{\"kind\":\"vm\",\"name\":\"init\",\"id\":", out);
+    fprintf(out, "%" PRIuPTR "}", object_id((Obj*)vm.init_string));
+
+    for (Value* slot = vm.stack; slot < vm.stack_top; slot++) {
+        write_root("stack", NULL, *slot);
+    }
+
+    for (int i = 0; i < vm.globals.capacity; i++) {
+        Entry* entry = &vm.globals.entries[i];
+        if (entry->key != NULL) {
+            write_root("global_name", entry->key, OBJ_VAL(entry->key));
+            write_root("global", entry->key, entry->value);
+        }
+    }
+
+    for (int i = 0; i < vm.frame_count; i++) {
+        ObjClosure*  closure = vm.frames[i].closure;
+        ObjFunction* function = DEREF(ObjFunction, closure->function);
+        write_root(
+            "frame", DEREF(ObjString, function->name), OBJ_VAL(closure));
+    }
+
+    for (ObjUpvalue* upvalue = vm.open_upvalues; upvalue != NULL;
+         upvalue = DEREF(ObjUpvalue, upvalue->next)) {
+        write_root("open_upvalue", NULL, OBJ_VAL(upvalue));
+    }
+
+    fputs("\n],\n", out);
+}
+
+static void
+write_ref(Obj* object) {
+    if (object == NULL)
+        return;
+
+    fprintf(out, wrote_ref ? ",%" PRIuPTR : "%" PRIuPTR, object_id(object));
+    wrote_ref = true;
+}
+
+static void
+write_value_ref(Value value) {
+    if (IS_OBJ(value)) {
+        write_ref(AS_OBJ(value));
+    }
+}
+
+static void
+write_hashmap_refs(const HashMap* map) {
+    for (int i = 0; i < map->capacity; i++) {
+        Entry* entry = &map->entries[i];
+        if (entry->key != NULL) {
+            write_ref((Obj*)entry->key);
+            write_value_ref(entry->value);
+        }
+    }
+}
+
+/// Get the memory an object takes up: its slot and the arrays it owns.
+static size_t
+object_size(Obj* object) {
+    size_t size = page_stride(page_of(object));
+    switch (object->type) {
+        case OBJ_FUNCTION: {
+            Bytecode* bytecode = &((ObjFunction*)object)->bytecode;
+            size += (size_t)bytecode->capacity
+                    * (sizeof(uint16_t) + sizeof(int));
+            size += (size_t)bytecode->constants.capacity * sizeof(Value);
+            break;
+        }
+        case OBJ_CLASS:
+            size += (size_t)((ObjClass*)object)->methods.capacity
+                    * sizeof(Entry);
+            break;
+        case OBJ_INSTANCE:
+            size += (size_t)((ObjInstance*)object)->fields.capacity
+                    * sizeof(Entry);
+            break;
+        case OBJ_WEAK_MAP:
+            size += (size_t)((ObjWeakMap*)object)->table.capacity
+                    * sizeof(WeakEntry);
+            break;
+        case OBJ_WEAK_REF:
+        case OBJ_ROPE:
+        case OBJ_SLICE:
+        case OBJ_UPVALUE:
+        case OBJ_CLOSURE:
+        case OBJ_NATIVE:
+        case OBJ_STRING:
+        case OBJ_BOUND_METHOD:
+            break;
+    }
+    return size;
+}
+
+static void
+write_object_label(Obj* object) {
+    switch (object->type) {
+        case OBJ_STRING:
+            write_label((ObjString*)object);
+            break;
+        case OBJ_FUNCTION:
+            write_label(DEREF(ObjString, ((ObjFunction*)object)->name));
+            break;
+        case OBJ_CLOSURE: {
+            ObjClosure*  closure = (ObjClosure*)object;
+            ObjFunction* function = DEREF(ObjFunction, closure->function);
+            write_label(DEREF(ObjString, function->name));
+            break;
+        }
+        case OBJ_CLASS:
+            write_label(DEREF(ObjString, ((ObjClass*)object)->name));
+            break;
+        case OBJ_SLICE: {
+            int length = ((ObjSlice*)object)->length;
+            if (length > HEAP_DUMP_MAX_LABEL) {
+                length = HEAP_DUMP_MAX_LABEL;
+            }
+            write_json_string(flat_chars(object), length);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)object;
+            write_label(
+                DEREF(ObjString, DEREF(ObjClass, instance->klass)->name));
+            break;
+        }
+        case OBJ_UPVALUE: {
+            ObjUpvalue* upvalue = (ObjUpvalue*)object;
+            fputs(
+                upvalue->location == &upvalue->closed ? "\"closed\""
+                                                      : "\"open\"",
+                out);
+            break;
+        }
+        case OBJ_NATIVE:
+        case OBJ_BOUND_METHOD:
+        case OBJ_ROPE:
+            // Labels are not worth flattening a rope for.
+        case OBJ_WEAK_REF:
+        case OBJ_WEAK_MAP:
+            fputs("\"\"", out);
+            break;
+    }
+}
+
+/// Write the references of an object, following the same fields as
+/// blacken_object.
+static void
+write_object_refs(Obj* object) {
+    switch (object->type) {
+        case OBJ_CLASS: {
+            ObjClass* klass = (ObjClass*)object;
+            write_ref((Obj*)DEREF(ObjString, klass->name));
+            write_hashmap_refs(&klass->methods);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)object;
+            write_ref((Obj*)DEREF(ObjClass, instance->klass));
+            write_hashmap_refs(&instance->fields);
+            break;
+        }
+        case OBJ_UPVALUE:
+            write_value_ref(((ObjUpvalue*)object)->closed);
+            break;
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            write_ref((Obj*)DEREF(ObjString, function->name));
+            for (int i = 0; i < function->bytecode.constants.count; i++) {
+                write_value_ref(function->bytecode.constants.values[i]);
+            }
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            write_ref((Obj*)DEREF(ObjFunction, closure->function));
+            for (int i = 0; i < closure->upvalue_count; i++) {
+                write_ref((Obj*)DEREF(ObjUpvalue, closure->upvalues[i]));
+            }
+            break;
+        }
+        case OBJ_BOUND_METHOD: {
+            ObjBoundMethod* bound = (ObjBoundMethod*)object;
+            write_value_ref(bound->receiver);
+            write_ref((Obj*)DEREF(ObjClosure, bound->method));
+            break;
+        }
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)object;
+            write_ref(DEREF(Obj, rope->left));
+            write_ref(DEREF(Obj, rope->right));
+            break;
+        }
+        case OBJ_SLICE:
+            write_ref((Obj*)DEREF(ObjString, ((ObjSlice*)object)->parent));
+            break;
+        case OBJ_WEAK_REF:
+        case OBJ_WEAK_MAP:
+            // Weak references keep nothing alive on their own.
+        case OBJ_NATIVE:
+        case OBJ_STRING:
+            break;
+    }
+}
+
+static void
+write_object(Obj* object) {
+    fprintf(
+        out,
+        "%s{\"id\":%" PRIuPTR ",\"type\":\"%s\",\"size\":%zu,\"label\":",
+        wrote_object ? ",\n" : "",
+        object_id(object),
+        object_type_name(object->type),
+        object_size(object));
+    write_object_label(object);
+
+    fputs(",\"refs\":[", out);
+    wrote_ref = false;
+    write_object_refs(object);
+    fputs("]}", out);
+    wrote_object = true;
+}
+
+bool
+heap_dump(const char* path) {
+    out = fopen(path, "w");
+    if (out == NULL)
+        return false;
+
+    fprintf(out, "{\"version\":1,\"bytes\":%zu,\n", vm.bytes_allocated);
+    write_roots();
+    fputs("\"objects\":[\n", out);
+    wrote_object = false;
+    for_each_heap_object(write_object);
+    fputs("\n]}\n", out);
+
+    bool written = !ferror(out);
+    written = fclose(out) == 0 && written;
+    out = NULL;
+    return written;
+}
+
+#ifdef SIGUSR1
+
+static void
+handle_signal(int signal_number) {
+    (void)signal_number;
+    heap_dump_requested = 1;
+}
+
+void
+heap_dump_on_signal(const char* path) {
+    signal_path = path;
+    signal(SIGUSR1, handle_signal);
+}
+
+#else
+
+void
+heap_dump_on_signal(const char* path) {
+    (void)path;
+}
+
+#endif
+
+void
+heap_dump_signaled(void) {
+    heap_dump_requested = 0;
+
+    size_t length = strlen(signal_path) + 32;
+    char*  name = (char*)malloc(length);
+    if (name == NULL)
+        return;
+
+    snprintf(name, length, "%s.%d.json", signal_path, ++signal_count);
+    if (heap_dump(name)) {
+        fprintf(stderr, "Wrote heap dump \"%s\".\n", name);
+    } else {
+        fprintf(stderr, "Could not write heap dump \"%s\".\n", name);
+    }
+    free(name);
+}
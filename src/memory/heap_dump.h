@@ -0,0 +1,42 @@
+// File:    heap_dump.h
+// Purpose: Definitions for heap snapshots, which write the object graph to
+//          a file for offline analysis.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <signal.h>
+#include <stdbool.h>
+
+// Set by the signal handler when a heap dump was asked for. The run loop
+// writes the dump at its next safepoint.
+extern volatile sig_atomic_t heap_dump_requested;
+
+/// Write every object in the heap and the roots that hold them to a JSON
+/// file. Each object has an id, its type, its size in bytes including the
+/// arrays it owns, a short label and the ids of the objects it references.
+/// Each root has a kind, such as "global" or "stack", a name and the id of
+/// the object it holds. analyze_heap.py reads the file.
+///
+/// Params:
+/// - path: The file to write.
+///
+/// Returns:
+/// - bool: True when the file was written.
+bool
+heap_dump(const char* path);
+
+/// Write a heap dump whenever the process receives SIGUSR1. The dumps are
+/// numbered, so the nth one goes to "path.n.json". Does nothing on systems
+/// without SIGUSR1.
+///
+/// Params:
+/// - path: The start of the file names. It must outlive the program.
+void
+heap_dump_on_signal(const char* path);
+
+/// Write the heap dump asked for by a signal. Called by the run loop at a
+/// safepoint once heap_dump_requested is set.
+void
+heap_dump_signaled(void);
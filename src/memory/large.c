@@ -0,0 +1,143 @@
+// File:    large.c
+// Purpose: Implement large.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // For mremap.
+#endif
+
+#include "large.h"
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+static size_t
+system_page_size(void) {
+    static size_t page_size = 0;
+    if (page_size == 0) {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        page_size = info.dwAllocationGranularity;
+#else
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+    return page_size;
+}
+
+static size_t
+round_to_pages(size_t size) {
+    size_t page_size = system_page_size();
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+#ifdef _WIN32
+
+// Windows maps at a granularity of 64 KiB, which is as much alignment as
+// any caller asks for.
+
+void*
+large_map(size_t size, size_t alignment) {
+    (void)alignment;
+    return VirtualAlloc(
+        NULL, round_to_pages(size), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void*
+large_remap(void* pointer, size_t old_size, size_t new_size) {
+    if (round_to_pages(old_size) == round_to_pages(new_size))
+        return pointer;
+
+    void* result = large_map(new_size, 0);
+    if (result == NULL)
+        return NULL;
+
+    memcpy(result, pointer, old_size < new_size ? old_size : new_size);
+    large_unmap(pointer, old_size);
+    return result;
+}
+
+void
+large_unmap(void* pointer, size_t size) {
+    (void)size;
+    VirtualFree(pointer, 0, MEM_RELEASE);
+}
+
+#else
+
+void*
+large_map(size_t size, size_t alignment) {
+    size = round_to_pages(size);
+    if (alignment < system_page_size()) {
+        alignment = system_page_size();
+    }
+
+    // Map enough to find an aligned start inside, then give back the
+    // pages on either side of the block.
+    size_t extra = alignment - system_page_size();
+    char*  mapping = (char*)mmap(
+        NULL,
+        size + extra,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0);
+    if (mapping == (char*)MAP_FAILED)
+        return NULL;
+
+    char* start = (char*)(((uintptr_t)mapping + alignment - 1)
+                          & ~(uintptr_t)(alignment - 1));
+    char* end = start + size;
+    if (start > mapping) {
+        munmap(mapping, (size_t)(start - mapping));
+    }
+    if (mapping + size + extra > end) {
+        munmap(end, (size_t)(mapping + size + extra - end));
+    }
+    return start;
+}
+
+void*
+large_remap(void* pointer, size_t old_size, size_t new_size) {
+    old_size = round_to_pages(old_size);
+    new_size = round_to_pages(new_size);
+    if (old_size == new_size)
+        return pointer;
+
+#ifdef __linux__
+    void* result = mremap(pointer, old_size, new_size, MREMAP_MAYMOVE);
+    return result == MAP_FAILED ? NULL : result;
+#else
+    if (new_size < old_size) {
+        munmap((char*)pointer + new_size, old_size - new_size);
+        return pointer;
+    }
+
+    void* result = large_map(new_size, 0);
+    if (result == NULL)
+        return NULL;
+
+    memcpy(result, pointer, old_size);
+    munmap(pointer, old_size);
+    return result;
+#endif
+}
+
+void
+large_unmap(void* pointer, size_t size) {
+    munmap(pointer, round_to_pages(size));
+}
+
+#endif
@@ -0,0 +1,49 @@
+// File:    large.h
+// Purpose: Definitions for the large-object space, which maps big blocks
+//          straight from the system.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <stddef.h>
+
+// Blocks bigger than this are mapped on their own rather than taken from
+// malloc or a shared page. Blocks this big are rare, and mapping them lets
+// them grow in place and go back to the system as soon as they are freed.
+#define LARGE_BLOCK_THRESHOLD (64 * 1024)
+
+/// Map a new block of zeroed memory.
+///
+/// Params:
+/// - size: The size in bytes of the block.
+/// - alignment: The alignment of the block, a power of two. The system page
+///   size is used when it is smaller.
+///
+/// Returns:
+/// - void*: The block, or NULL when the system is out of memory.
+void*
+large_map(size_t size, size_t alignment);
+
+/// Change the size of a mapped block. Where the system allows it, the pages
+/// are moved rather than copied.
+///
+/// Params:
+/// - pointer: A block returned by large_map with no alignment beyond the
+///   system page size.
+/// - old_size: The size in bytes the block was mapped with.
+/// - new_size: The size in bytes the block should have.
+///
+/// Returns:
+/// - void*: The block, which may have moved, or NULL when the system is out
+///   of memory.
+void*
+large_remap(void* pointer, size_t old_size, size_t new_size);
+
+/// Return a mapped block to the system.
+///
+/// Params:
+/// - pointer: A block returned by large_map or large_remap.
+/// - size: The size in bytes the block was last mapped with.
+void
+large_unmap(void* pointer, size_t size);
@@ -4,55 +4,452 @@
 // Date:    2025-08-17
 
 #include "memory.h"
+#include "arena.h"
 #include "bytecode.h"
 #include "common.h"
 #include "compiler.h"
+#include "large.h"
 #include "object.h"
+#include "page.h"
+#include "profile.h"
 #include "value.h"
 #include "vm.h"
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
 
 #ifdef DEBUG_LOG_GC
 #include "debug.h"
-#include <stdio.h>
 #endif
 
-#define GC_HEAP_GROW_FACTOR 2
+// How far past its trigger the heap may grow while a cycle is marking,
+// as a factor, before the cycle is finished at once.
+#define GC_OVERSHOOT_FACTOR 2
 
-void*
-reallocate(void* pointer, size_t old_size, size_t new_size) {
-    vm.bytes_allocated += new_size - old_size;
-    if (new_size > old_size) {
-#ifdef DEBUG_STRESS_GC
+// The least room, in percent of the live heap, that the pacer leaves the
+// program before the next cycle, however cheap the collector is.
+#define GC_MIN_GROW_PERCENT 10
+
+// The most room, as a factor of the live heap, that the pacer leaves the
+// program, so a noisy measurement cannot let the heap balloon.
+#define GC_MAX_GROW_FACTOR 4
+
+// The number of bytes the program may allocate between two mark slices.
+#define GC_SLICE_BYTES (64 * 1024)
+
+// How many objects are blackened between checks of the slice deadline.
+#define GC_SLICE_CHECK_INTERVAL 32
+
+// How many gray objects a mark worker keeps before sharing half of them.
+#define GC_SHARE_THRESHOLD 64
+
+// The share of page memory, in percent, that must be free before the heap
+// is compacted. Pages used below this share are the ones that are emptied.
+#define GC_COMPACT_FREE_PERCENT 50
+
+// The least page memory that is worth compacting.
+#define GC_COMPACT_MIN_BYTES (4 * PAGE_SIZE)
+
+/// A thread that takes part in parallel marking. Each worker drains its own
+/// private stack and offers surplus work on a shared stack that the other
+/// workers can steal from.
+typedef struct {
+    GrayStack  local;        // Private work, only touched by the owner.
+    GrayStack  shared;       // Work that other workers may steal.
+    atomic_int shared_count; // The size of shared, readable without lock.
+    mtx_t      lock;         // Guards the shared stack.
+    thrd_t     thread;       // The thread running the worker.
+} MarkWorker;
+
+static MarkWorker workers[GC_MAX_THREADS];
+static int        worker_count = 0;
+static bool       workers_ready = false;
+static atomic_int idle_workers;
+
+// The worker that the current thread is running, if any.
+static _Thread_local MarkWorker* current_worker = NULL;
+
+/// A thread that takes part in parallel sweeping. Pages are not shared
+/// between threads, so the cells it frees are handed back by the main
+/// thread once the sweep is over.
+typedef struct {
+    size_t    freed;  // The number of bytes the thread has freed.
+    PageSlot* dead;   // Freed cells waiting to return to their pages.
+    thrd_t    thread; // The thread running the sweeper.
+} Sweeper;
+
+// The sweeper that the current thread is running. The main thread leaves
+// this unset and updates vm.bytes_allocated directly.
+static _Thread_local Sweeper* current_sweeper = NULL;
+
+// The pages being swept in parallel, claimed through next_sweep_page.
+static Page**     sweep_pages = NULL;
+static int        sweep_page_count = 0;
+static atomic_int next_sweep_page;
+
+// Room to copy the entries of a weak map aside while a compaction places
+// them again, big enough for the largest one.
+static WeakEntry* weak_scratch = NULL;
+
+/// What the pacer measures to place the trigger of the next cycle. Times
+/// are in microseconds.
+typedef struct {
+    uint64_t work_start;   // When the gc work now running began.
+    uint64_t gc_time;      // Time spent on the cycle before that work.
+    uint64_t marker_time;  // Time the concurrent marker spent marking.
+    uint64_t cycle_start;  // When the current cycle began.
+    size_t   start_bytes;  // The heap size when the current cycle began.
+    uint64_t last_end;     // When the last cycle finished its sweep.
+    size_t   live_bytes;   // The heap size when the last cycle finished.
+    double   rate;         // Smoothed bytes allocated per microsecond.
+} Pacer;
+
+static Pacer pacer;
+
+// The bytes freed so far by the sweep of the current cycle.
+static size_t cycle_freed = 0;
+
+// Set while buffers come from the arena. A run in arena mode takes them
+// from there until its first collection.
+static bool arena_open = false;
+
+static void
+gc_step();
+
+static void
+start_concurrent_mark();
+
+static bool
+reallocate_deferred(
+    void* pointer, size_t old_size, size_t new_size, void** result);
+
+static void
+free_gray_stack(GrayStack* stack);
+
+static void
+sweep_next_page();
+
+static uint64_t
+now_us();
+
+/// Count a pause in the gc statistics.
+///
+/// Params:
+/// - pause_us: The length of the pause in microseconds.
+static void
+record_pause(uint64_t pause_us) {
+    GcStats* stats = &vm.gc_stats;
+    stats->pauses++;
+    stats->total_pause_us += pause_us;
+    if (pause_us > stats->max_pause_us) {
+        stats->max_pause_us = pause_us;
+    }
+
+    int      bucket = 0;
+    uint64_t bound = 10;
+    while (bucket < GC_PAUSE_BUCKETS - 1 && pause_us >= bound) {
+        bucket++;
+        bound *= 10;
+    }
+    stats->histogram[bucket]++;
+}
+
+/// Run a piece of gc work on behalf of the program, charge its time to the
+/// current cycle and count it as a pause.
+///
+/// Params:
+/// - work: The work to run.
+static void
+run_gc_work(void (*work)()) {
+    uint64_t start = now_us();
+    pacer.work_start = start;
+    work();
+
+    // The work may begin a cycle, which moves work_start.
+    uint64_t end = now_us();
+    pacer.gc_time += end - pacer.work_start;
+    record_pause(end - start);
+}
+
+/// Sweep the pages a lazy sweep has not reached yet.
+static void
+finish_lazy_sweep() {
+    while (vm.unswept != NULL) {
+        sweep_next_page();
+    }
+}
+
+/// Free everything that is unreachable right now. A cycle in progress is
+/// finished first, but it keeps the objects that were live when it began,
+/// so a fresh cycle follows it. Every page is swept before this returns.
+static void
+collect_all() {
+    bool in_progress = vm.gc_phase != GC_IDLE;
+    collect_garbage();
+    if (in_progress) {
         collect_garbage();
+    }
+
+    finish_lazy_sweep();
+}
+
+void
+fail_allocation(size_t growth) {
+    vm.bytes_allocated -= growth;
+    raise_out_of_memory();
+    exit(1);
+}
+
+/// Keep the heap under its limit by collecting everything that can go.
+/// When the heap is still over, the allocation fails. The compiler cannot
+/// be unwound, so while no program is running the allocation goes ahead.
+///
+/// Params:
+/// - growth: The bytes the allocation added to the heap size.
+static void
+enforce_heap_limit(size_t growth) {
+    run_gc_work(collect_all);
+    if (vm.bytes_allocated <= vm.gc_config.heap_limit)
+        return;
+
+    vm.bytes_allocated -= growth;
+    raise_out_of_memory();
+    vm.bytes_allocated += growth;
+}
+
+/// Start or advance a collection when an allocation pushes the heap past
+/// its threshold. Runs before the new memory is handed out.
+static void
+collect_if_needed(size_t growth) {
+#ifdef DEBUG_STRESS_GC
+    run_gc_work(collect_garbage);
 #endif
+
+    if (vm.gc_phase == GC_CONCURRENT) {
+        if (atomic_load(&vm.marker_done)
+            || vm.bytes_allocated > vm.next_gc * GC_OVERSHOOT_FACTOR) {
+            run_gc_work(collect_garbage);
+        }
+    } else if (vm.gc_phase == GC_MARKING) {
+        vm.gc_step_bytes += growth;
+        if (vm.bytes_allocated > vm.next_gc * GC_OVERSHOOT_FACTOR) {
+            // Marking is falling behind the program, so finish the
+            // cycle now rather than letting the heap grow unbounded.
+            run_gc_work(collect_garbage);
+        } else if (vm.gc_step_bytes >= GC_SLICE_BYTES) {
+            run_gc_work(gc_step);
+        }
+    } else if (vm.unswept != NULL) {
+        run_gc_work(sweep_next_page);
+    } else if (vm.bytes_allocated > vm.next_gc) {
+        if (vm.gc_config.concurrent) {
+            run_gc_work(start_concurrent_mark);
+        } else if (vm.gc_config.incremental) {
+            run_gc_work(gc_step);
+        } else {
+            run_gc_work(collect_garbage);
+        }
     }
 
-    if (vm.bytes_allocated > vm.next_gc) {
-        collect_garbage();
+    if (vm.gc_config.heap_limit != 0
+        && vm.bytes_allocated > vm.gc_config.heap_limit) {
+        enforce_heap_limit(growth);
     }
+}
 
-    void* result;
+/// Release a buffer to wherever it came from. Buffers from the arena are
+/// only released when the whole arena is.
+static void
+release_block(void* pointer, size_t size) {
+    if (arena_contains(pointer))
+        return;
 
-    if (new_size == 0) {
+    if (size > LARGE_BLOCK_THRESHOLD) {
+        large_unmap(pointer, size);
+    } else {
         free(pointer);
+    }
+}
+
+/// Resize a buffer. Buffers bigger than LARGE_BLOCK_THRESHOLD live in the
+/// large-object space, so growing one remaps its pages rather than copying
+/// them, and freeing one returns its pages to the system.
+static void*
+resize_block(void* pointer, size_t old_size, size_t new_size) {
+    bool in_arena = pointer != NULL && arena_contains(pointer);
+    if (arena_open && (pointer == NULL || in_arena))
+        return arena_resize(pointer, old_size, new_size);
+
+    if (in_arena || arena_open) {
+        // The buffer moves into or out of the arena.
+        void* result = resize_block(NULL, 0, new_size);
+        if (result != NULL) {
+            memcpy(result, pointer, old_size < new_size ? old_size : new_size);
+            release_block(pointer, old_size);
+        }
+        return result;
+    }
+
+    bool was_large = old_size > LARGE_BLOCK_THRESHOLD;
+    bool is_large = new_size > LARGE_BLOCK_THRESHOLD;
+    if (pointer != NULL && was_large == is_large) {
+        return is_large ? large_remap(pointer, old_size, new_size)
+                        : realloc(pointer, new_size);
+    }
+
+    void* result = is_large ? large_map(new_size, 0) : malloc(new_size);
+    if (result != NULL && pointer != NULL) {
+        memcpy(result, pointer, old_size < new_size ? old_size : new_size);
+        release_block(pointer, old_size);
+    }
+    return result;
+}
+
+void*
+reallocate(void* pointer, size_t old_size, size_t new_size) {
+    if (current_sweeper != NULL) {
+        // Sweeper threads only ever free memory.
+        current_sweeper->freed += old_size;
+        release_block(pointer, old_size);
         return NULL;
     }
 
-    if (pointer == NULL) {
-        // New allocation
-        result = malloc(new_size);
-    } else {
-        result = realloc(pointer, new_size);
+    vm.bytes_allocated += new_size - old_size;
+    if (new_size > old_size) {
+        collect_if_needed(new_size - old_size);
+        if (profile_is_due(new_size - old_size)) {
+            profile_sample(NULL);
+        }
+    }
+
+    if (vm.gc_phase == GC_CONCURRENT && pointer != NULL) {
+        void* result;
+        if (reallocate_deferred(pointer, old_size, new_size, &result))
+            return result;
+        // Ending the cycle frees the deferred blocks, and the block can be
+        // resized in place after it.
+        run_gc_work(collect_all);
     }
 
+    if (new_size == 0) {
+        release_block(pointer, old_size);
+        return NULL;
+    }
+
+    void* result = resize_block(pointer, old_size, new_size);
     if (result == NULL) {
-        exit(1);
+        // Free what can be freed and try once more.
+        run_gc_work(collect_all);
+        result = resize_block(pointer, old_size, new_size);
+    }
+    if (result == NULL) {
+        fail_allocation(new_size - old_size);
     }
 
     return result;
 }
 
+void*
+allocate_cell(size_t size) {
+    size = page_slot_size(size);
+    vm.bytes_allocated += size;
+    collect_if_needed(size);
+
+    void* cell = page_allocate(size);
+    if (cell == NULL) {
+        run_gc_work(collect_all);
+        cell = page_allocate(size);
+    }
+    if (cell == NULL) {
+        fail_allocation(size);
+    }
+
+    return cell;
+}
+
+void
+free_cell(void* pointer, size_t size) {
+    size = page_slot_size(size);
+    if (current_sweeper != NULL) {
+        PageSlot* slot = (PageSlot*)pointer;
+        slot->next = current_sweeper->dead;
+        current_sweeper->dead = slot;
+        current_sweeper->freed += size;
+        return;
+    }
+
+    vm.bytes_allocated -= size;
+    page_free(pointer);
+}
+
+/// Make room for one more deferred free. The list is left as it is when
+/// there is no memory for it.
+///
+/// Returns: Whether there is room.
+static bool
+reserve_deferred_free() {
+    if (vm.deferred_capacity >= vm.deferred_count + 1)
+        return true;
+
+    int           capacity = GROW_CAPACITY(vm.deferred_capacity);
+    DeferredFree* frees = (DeferredFree*)realloc(
+        vm.deferred_frees, sizeof(DeferredFree) * capacity);
+    if (frees == NULL)
+        return false;
+
+    vm.deferred_frees = frees;
+    vm.deferred_capacity = capacity;
+    return true;
+}
+
+/// Move a block of memory while the marker thread may still be reading it.
+/// The old block stays valid until marking ends.
+///
+/// Params:
+/// - pointer: The block to move.
+/// - old_size: The size of the block.
+/// - new_size: The size of the moved block, 0 to only free it.
+/// - result: Set to the moved block.
+///
+/// Returns: Whether there was memory for it. When not, nothing is changed.
+static bool
+reallocate_deferred(
+    void* pointer, size_t old_size, size_t new_size, void** result) {
+    if (!reserve_deferred_free())
+        return false;
+
+    *result = NULL;
+    if (new_size > 0) {
+        *result = resize_block(NULL, 0, new_size);
+        if (*result == NULL)
+            return false;
+        memcpy(*result, pointer, old_size < new_size ? old_size : new_size);
+    }
+
+    vm.deferred_frees[vm.deferred_count++] = (DeferredFree){pointer, old_size};
+    return true;
+}
+
+static void
+free_deferred() {
+    for (int i = 0; i < vm.deferred_count; i++) {
+        release_block(vm.deferred_frees[i].pointer, vm.deferred_frees[i].size);
+    }
+    vm.deferred_count = 0;
+}
+
+static void
+finish_concurrent_mark();
+
+static void
+for_each_object(Page* page, void (*visit)(Obj*));
+
+static void
+for_each_large_object(void (*visit)(Obj*));
+
 static void
 free_object(Obj* object) {
 #ifdef DEBUG_LOG_GC
@@ -63,43 +460,62 @@ free_object(Obj* object) {
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
             free_bytecode(&function->bytecode);
-            FREE(ObjFunction, object);
+            FREE_OBJ(ObjFunction, object);
             break;
         }
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
-            FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalue_count);
-            FREE(ObjClosure, object);
+            free_cell(
+                object,
+                sizeof(ObjClosure)
+                    + sizeof(REF(ObjUpvalue)) * closure->upvalue_count);
             break;
         }
         case OBJ_UPVALUE: {
-            FREE(ObjUpvalue, object);
+            FREE_OBJ(ObjUpvalue, object);
             break;
         }
         case OBJ_NATIVE: {
-            FREE(ObjNative, object);
+            FREE_OBJ(ObjNative, object);
             break;
         }
         case OBJ_STRING: {
             ObjString* string = (ObjString*)object;
-            FREE_ARRAY(char, string->chars, string->length + 1);
-            FREE(ObjString, object);
+            free_cell(object, sizeof(ObjString) + string->length + 1);
             break;
         }
         case OBJ_CLASS: {
             ObjClass* klass = (ObjClass*)object;
             free_hashmap(&klass->methods);
-            FREE(ObjClass, object);
+            FREE_OBJ(ObjClass, object);
             break;
         }
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)object;
             free_hashmap(&instance->fields);
-            FREE(ObjInstance, object);
+            FREE_OBJ(ObjInstance, object);
             break;
         }
         case OBJ_BOUND_METHOD: {
-            FREE(ObjBoundMethod, object);
+            FREE_OBJ(ObjBoundMethod, object);
+            break;
+        }
+        case OBJ_WEAK_REF: {
+            FREE_OBJ(ObjWeakRef, object);
+            break;
+        }
+        case OBJ_WEAK_MAP: {
+            ObjWeakMap* map = (ObjWeakMap*)object;
+            free_weak_table(&map->table);
+            FREE_OBJ(ObjWeakMap, object);
+            break;
+        }
+        case OBJ_ROPE: {
+            FREE_OBJ(ObjRope, object);
+            break;
+        }
+        case OBJ_SLICE: {
+            FREE_OBJ(ObjSlice, object);
             break;
         }
     }
@@ -107,14 +523,111 @@ free_object(Obj* object) {
 
 void
 free_objects(void) {
-    Obj* object = vm.objects;
-    while (object != NULL) {
-        Obj* next = object->next;
-        free_object(object);
-        object = next;
+    if (vm.gc_phase == GC_CONCURRENT) {
+        finish_concurrent_mark();
+    }
+    vm.gc_phase = GC_IDLE;
+
+    // While the arena is open, every buffer the objects own is in it, so
+    // the objects need no freeing one by one.
+    if (!arena_open) {
+        for (Page* page = page_heap(); page != NULL;
+             page = page->next_in_heap) {
+            for_each_object(page, free_object);
+        }
+        for_each_large_object(free_object);
+    }
+    vm.unswept = NULL;
+    profile_forget();
+
+    free_gray_stack(&vm.gray_stack);
+    free_gray_stack(&vm.satb_log);
+    free(vm.deferred_frees);
+    free(sweep_pages);
+    sweep_pages = NULL;
+    free_pages();
+    arena_reset();
+    arena_open = false;
+
+    if (workers_ready) {
+        for (int i = 0; i < GC_MAX_THREADS; i++) {
+            free_gray_stack(&workers[i].local);
+            free_gray_stack(&workers[i].shared);
+            mtx_destroy(&workers[i].lock);
+        }
+        workers_ready = false;
+    }
+}
+
+void
+init_gc_config(GcConfig* config) {
+    config->incremental = false;
+    config->concurrent = false;
+    config->lazy_sweep = false;
+    config->compact = false;
+    config->threads = 1;
+    config->max_pause_us = GC_DEFAULT_MAX_PAUSE_US;
+    config->headroom_percent = GC_DEFAULT_HEADROOM_PERCENT;
+    config->cpu_percent = GC_DEFAULT_CPU_PERCENT;
+    config->min_heap = GC_DEFAULT_MIN_HEAP;
+    config->max_heap = 0;
+    config->heap_limit = 0;
+    config->arena = false;
+    config->arena_budget = ARENA_DEFAULT_BUDGET;
+}
+
+void
+apply_gc_config(void) {
+    // The pacer clamps to min_heap last, so a lower max_heap would be lost.
+    if (vm.gc_config.max_heap != 0
+        && vm.gc_config.min_heap > vm.gc_config.max_heap) {
+        vm.gc_config.min_heap = vm.gc_config.max_heap;
+    }
+
+    arena_open = vm.gc_config.arena;
+    vm.next_gc =
+        arena_open ? vm.gc_config.arena_budget : vm.gc_config.min_heap;
+    pacer.last_end = now_us();
+    pacer.live_bytes = vm.bytes_allocated;
+}
+
+void
+init_gray_stack(GrayStack* stack) {
+    stack->count = 0;
+    stack->capacity = 0;
+    stack->objects = NULL;
+}
+
+static void
+free_gray_stack(GrayStack* stack) {
+    free(stack->objects);
+    init_gray_stack(stack);
+}
+
+static void
+push_gray_stack(GrayStack* stack, Obj* object) {
+    if (stack->capacity < stack->count + 1) {
+        stack->capacity = GROW_CAPACITY(stack->capacity);
+        stack->objects =
+            (Obj**)realloc(stack->objects, sizeof(Obj*) * stack->capacity);
+
+        // The marker threads cannot unwind into the program, and a cycle
+        // cut short would free live objects, so this is the one place
+        // where running out of memory still exits.
+        if (stack->objects == NULL)
+            exit(1);
     }
 
-    free(vm.gray_stack);
+    stack->objects[stack->count++] = object;
+}
+
+void
+gray_object(Obj* object) {
+    if (current_worker != NULL) {
+        push_gray_stack(&current_worker->local, object);
+    } else {
+        push_gray_stack(&vm.gray_stack, object);
+    }
 }
 
 void
@@ -122,7 +635,7 @@ mark_object(Obj* object) {
     if (object == NULL)
         return;
 
-    if (object->is_marked)
+    if (is_object_marked(object))
         return;
 
 #ifdef DEBUG_LOG_GC
@@ -131,18 +644,12 @@ mark_object(Obj* object) {
     printf("\n");
 #endif
 
-    object->is_marked = true;
-
-    if (vm.gray_capacity < vm.gray_count + 1) {
-        vm.gray_capacity = GROW_CAPACITY(vm.gray_capacity);
-        vm.gray_stack =
-            (Obj**)realloc(vm.gray_stack, sizeof(Obj*) * vm.gray_capacity);
-
-        if (vm.gray_stack == NULL)
-            exit(1);
-    }
+    // Another worker may be racing to mark the same object, and only the
+    // one that sets the bit traces it.
+    if (!set_object_marked(object))
+        return;
 
-    vm.gray_stack[vm.gray_count++] = object;
+    gray_object(object);
 }
 
 void
@@ -153,8 +660,14 @@ mark_value(Value value) {
 
 static void
 mark_array(ValueArray* array) {
-    for (int i = 0; i < array->count; i++) {
-        mark_value(array->values[i]);
+    // A concurrent marker may race the compiler appending constants, which
+    // publishes the slot before the count.
+    int count = array->count;
+    atomic_thread_fence(memory_order_acquire);
+    Value* values = array->values;
+
+    for (int i = 0; i < count; i++) {
+        mark_value(values[i]);
     }
 }
 
@@ -173,7 +686,7 @@ mark_roots() {
     }
 
     for (ObjUpvalue* upvalue = vm.open_upvalues; upvalue != NULL;
-         upvalue = upvalue->next) {
+         upvalue = DEREF(ObjUpvalue, upvalue->next)) {
         mark_object((Obj*)upvalue);
     }
 }
@@ -189,13 +702,13 @@ blacken_object(Obj* object) {
     switch (object->type) {
         case OBJ_CLASS: {
             ObjClass* klass = (ObjClass*)object;
-            mark_object((Obj*)klass->name);
+            mark_object((Obj*)DEREF(ObjString, klass->name));
             mark_hashmap(&klass->methods);
             break;
         }
         case OBJ_INSTANCE: {
             ObjInstance* instance = (ObjInstance*)object;
-            mark_object((Obj*)instance->klass);
+            mark_object((Obj*)DEREF(ObjClass, instance->klass));
             mark_hashmap(&instance->fields);
             break;
         }
@@ -204,24 +717,36 @@ blacken_object(Obj* object) {
             break;
         case OBJ_FUNCTION: {
             ObjFunction* function = (ObjFunction*)object;
-            mark_object((Obj*)function->name);
+            mark_object((Obj*)DEREF(ObjString, function->name));
             mark_array(&function->bytecode.constants);
             break;
         }
         case OBJ_CLOSURE: {
             ObjClosure* closure = (ObjClosure*)object;
-            mark_object((Obj*)closure->function);
+            mark_object((Obj*)DEREF(ObjFunction, closure->function));
             for (int i = 0; i < closure->upvalue_count; i++) {
-                mark_object((Obj*)closure->upvalues[i]);
+                mark_object((Obj*)DEREF(ObjUpvalue, closure->upvalues[i]));
             }
             break;
         }
         case OBJ_BOUND_METHOD: {
             ObjBoundMethod* bound = (ObjBoundMethod*)object;
             mark_value(bound->receiver);
-            mark_object((Obj*)bound->method);
+            mark_object((Obj*)DEREF(ObjClosure, bound->method));
+            break;
+        }
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)object;
+            mark_object(DEREF(Obj, rope->left));
+            mark_object(DEREF(Obj, rope->right));
             break;
         }
+        case OBJ_SLICE:
+            mark_object((Obj*)DEREF(ObjString, ((ObjSlice*)object)->parent));
+            break;
+        case OBJ_WEAK_REF:
+        case OBJ_WEAK_MAP:
+            // What these hold is marked by trace_ephemerons, if at all.
         case OBJ_NATIVE:
         case OBJ_STRING:
             break;
@@ -229,57 +754,972 @@ blacken_object(Obj* object) {
 }
 
 static void
-trace_references() {
-    while (vm.gray_count > 0) {
-        Obj* object = vm.gray_stack[--vm.gray_count];
-        blacken_object(object);
+init_workers() {
+    for (int i = 0; i < GC_MAX_THREADS; i++) {
+        init_gray_stack(&workers[i].local);
+        init_gray_stack(&workers[i].shared);
+        atomic_init(&workers[i].shared_count, 0);
+        if (mtx_init(&workers[i].lock, mtx_plain) != thrd_success)
+            exit(1);
     }
+    workers_ready = true;
 }
 
+/// Move the older half of a worker's private stack to its shared stack, so
+/// that idle workers can steal it.
 static void
-sweep() {
-    Obj* previous = NULL;
-    Obj* object = vm.objects;
-    while (object != NULL) {
-        if (object->is_marked) {
-            object->is_marked = false;
-            previous = object;
-            object = object->next;
-        } else {
-            Obj* unreached = object;
-            object = object->next;
-            if (previous != NULL) {
-                previous->next = object;
-            } else {
-                vm.objects = object;
+share_work(MarkWorker* worker) {
+    int half = worker->local.count / 2;
+
+    mtx_lock(&worker->lock);
+    for (int i = 0; i < half; i++) {
+        push_gray_stack(&worker->shared, worker->local.objects[i]);
+    }
+    atomic_store(&worker->shared_count, worker->shared.count);
+    mtx_unlock(&worker->lock);
+
+    worker->local.count -= half;
+    memmove(
+        worker->local.objects,
+        worker->local.objects + half,
+        sizeof(Obj*) * worker->local.count);
+}
+
+/// Take half of the shared work of a victim into the private stack of a
+/// thief, which may be the same worker.
+static bool
+steal_work(MarkWorker* thief, MarkWorker* victim) {
+    if (atomic_load(&victim->shared_count) == 0)
+        return false;
+
+    mtx_lock(&victim->lock);
+    int take = (victim->shared.count + 1) / 2;
+    for (int i = 0; i < take; i++) {
+        push_gray_stack(
+            &thief->local, victim->shared.objects[--victim->shared.count]);
+    }
+    atomic_store(&victim->shared_count, victim->shared.count);
+    mtx_unlock(&victim->lock);
+
+    return take > 0;
+}
+
+static bool
+find_work(MarkWorker* worker) {
+    int index = (int)(worker - workers);
+    for (int i = 0; i < worker_count; i++) {
+        if (steal_work(worker, &workers[(index + i) % worker_count]))
+            return true;
+    }
+    return false;
+}
+
+/// Look for more work once a worker has run dry. Workers only publish work
+/// while they are busy, and each one takes back its own shared work before
+/// going idle, so marking is done once every worker is idle.
+///
+/// Returns:
+/// - bool: True when work was found, false when marking is complete.
+static bool
+take_work(MarkWorker* worker) {
+    if (find_work(worker))
+        return true;
+
+    atomic_fetch_add(&idle_workers, 1);
+    for (;;) {
+        if (atomic_load(&idle_workers) == worker_count)
+            return false;
+
+        for (int i = 0; i < worker_count; i++) {
+            if (atomic_load(&workers[i].shared_count) > 0) {
+                atomic_fetch_sub(&idle_workers, 1);
+                if (find_work(worker))
+                    return true;
+                atomic_fetch_add(&idle_workers, 1);
+                break;
+            }
+        }
+
+        thrd_yield();
+    }
+}
+
+static void
+drain_worker(MarkWorker* worker) {
+    current_worker = worker;
+
+    do {
+        while (worker->local.count > 0) {
+            Obj* object = worker->local.objects[--worker->local.count];
+            blacken_object(object);
+
+            if (worker->local.count > GC_SHARE_THRESHOLD
+                && atomic_load_explicit(
+                       &worker->shared_count, memory_order_relaxed)
+                       == 0) {
+                share_work(worker);
             }
+        }
+    } while (take_work(worker));
+
+    current_worker = NULL;
+}
+
+static int
+run_mark_worker(void* arg) {
+    drain_worker((MarkWorker*)arg);
+    return 0;
+}
+
+/// Trace the gray objects with several threads. The calling thread takes
+/// part as the first worker.
+static void
+trace_references_parallel() {
+    if (!workers_ready) {
+        init_workers();
+    }
+
+    worker_count = vm.gc_config.threads;
+    atomic_store(&idle_workers, 0);
 
-            free_object(unreached);
+    for (int i = 0; i < vm.gray_stack.count; i++) {
+        push_gray_stack(
+            &workers[i % worker_count].shared, vm.gray_stack.objects[i]);
+    }
+    vm.gray_stack.count = 0;
+
+    for (int i = 0; i < worker_count; i++) {
+        atomic_store(&workers[i].shared_count, workers[i].shared.count);
+    }
+
+    bool started[GC_MAX_THREADS] = {false};
+    for (int i = 1; i < worker_count; i++) {
+        started[i] =
+            thrd_create(&workers[i].thread, run_mark_worker, &workers[i])
+            == thrd_success;
+        if (!started[i]) {
+            // The others steal its shared work, so it only counts as idle.
+            atomic_fetch_add(&idle_workers, 1);
+        }
+    }
+
+    drain_worker(&workers[0]);
+
+    for (int i = 1; i < worker_count; i++) {
+        if (started[i]) {
+            thrd_join(workers[i].thread, NULL);
         }
     }
 }
 
-void
-collect_garbage() {
-#ifdef DEBUG_LOG_GC
-    printf("-- gc begin\n");
-    size_t before = vm.bytes_allocated;
-#endif
+static void
+trace_references() {
+    if (vm.gc_config.threads > 1) {
+        trace_references_parallel();
+        return;
+    }
 
-    mark_roots();
-    trace_references();
-    hashmap_remove_white(&vm.strings);
-    sweep();
+    while (vm.gray_stack.count > 0) {
+        Obj* object = vm.gray_stack.objects[--vm.gray_stack.count];
+        blacken_object(object);
+    }
+}
 
-    vm.next_gc = vm.bytes_allocated * GC_HEAP_GROW_FACTOR;
+/// Call a function on every object that a page holds.
+///
+/// Params:
+/// - page: The page to walk.
+/// - visit: The function to call.
+static void
+for_each_object(Page* page, void (*visit)(Obj*)) {
+    size_t stride = page_stride(page);
+    for (char* slot = page_first_slot(page); slot < page->unused;
+         slot += stride) {
+        if (page_is_allocated(slot)) {
+            visit((Obj*)slot);
+        }
+    }
+}
 
-#ifdef DEBUG_LOG_GC
-    printf("-- gc end\n");
-    printf(
+/// Call a function on each large object. The object may be freed by the
+/// call, which releases its page.
+///
+/// Params:
+/// - visit: The function to call.
+static void
+for_each_large_object(void (*visit)(Obj*)) {
+    Page* page = page_large_objects();
+    while (page != NULL) {
+        Page* next = page->next_in_heap;
+        visit((Obj*)page_first_slot(page));
+        page = next;
+    }
+}
+
+static void
+sweep_object(Obj* object) {
+    if (!is_object_marked(object)) {
+        free_object(object);
+    }
+}
+
+/// Free the unmarked objects of a page. Only the page bitmaps are read for
+/// the objects that stay, and their marks are left for begin_cycle to
+/// clear.
+static void
+sweep_page(Page* page) {
+    for_each_object(page, sweep_object);
+}
+
+/// Ask for a compaction at the next safepoint when too much of the page
+/// memory sits in free slots.
+static void
+check_fragmentation() {
+    if (!vm.gc_config.compact)
+        return;
+
+    size_t used;
+    size_t reserved;
+    page_usage(&used, &reserved);
+    if (reserved >= GC_COMPACT_MIN_BYTES
+        && (reserved - used) * 100 >= reserved * GC_COMPACT_FREE_PERCENT) {
+        vm.compact_pending = true;
+    }
+}
+
+/// Hand the memory of idle pages back to the system, keeping enough spare
+/// pages for the program to grow by the headroom without asking for more.
+static void
+scavenge() {
+    size_t used;
+    size_t reserved;
+    page_usage(&used, &reserved);
+
+#ifdef DEBUG_LOG_GC
+    size_t before = page_scavenged_bytes();
+#endif
+
+    page_scavenge(reserved / 100 * vm.gc_config.headroom_percent);
+
+#ifdef DEBUG_LOG_GC
+    printf("   scavenged %zu bytes\n", page_scavenged_bytes() - before);
+#endif
+}
+
+/// Place the trigger of the next cycle. The program allocated at some rate
+/// before this cycle, and the cycle cost some time. Collecting that heap
+/// again once the program has allocated rate * cost * (100 - p) / p more
+/// bytes spends about p percent of the time in the gc, where p is the cpu
+/// target. The result is bounded by the heap settings.
+static void
+pace_next_cycle() {
+    uint64_t now = now_us();
+    uint64_t cost = pacer.gc_time + (now - pacer.work_start);
+    uint64_t mutator_time = pacer.cycle_start > pacer.last_end
+                                ? pacer.cycle_start - pacer.last_end
+                                : 0;
+    if (mutator_time > 0 && pacer.start_bytes > pacer.live_bytes) {
+        double rate =
+            (double)(pacer.start_bytes - pacer.live_bytes) / mutator_time;
+        pacer.rate = pacer.rate == 0 ? rate : (pacer.rate + rate) / 2;
+    }
+
+    size_t live = vm.bytes_allocated;
+    double target = (double)vm.gc_config.cpu_percent;
+    double room = pacer.rate * (double)cost * (100 - target) / target;
+    double max_room = (double)live * (GC_MAX_GROW_FACTOR - 1);
+    size_t min_room = live / 100 * GC_MIN_GROW_PERCENT;
+
+    size_t next = live + (room > max_room ? (size_t)max_room : (size_t)room);
+    if (vm.gc_config.max_heap != 0 && next > vm.gc_config.max_heap) {
+        next = vm.gc_config.max_heap;
+    }
+    if (vm.gc_config.heap_limit != 0 && next > vm.gc_config.heap_limit) {
+        next = vm.gc_config.heap_limit;
+    }
+    if (next < live + min_room) {
+        next = live + min_room;
+    }
+    if (next < vm.gc_config.min_heap) {
+        next = vm.gc_config.min_heap;
+    }
+
+    vm.next_gc = next;
+    pacer.last_end = now;
+    pacer.live_bytes = live;
+}
+
+/// Wrap up a sweep once every page has been visited.
+static void
+finish_sweep() {
+    vm.gc_stats.collections++;
+    vm.gc_stats.last_freed = cycle_freed;
+    vm.gc_stats.total_freed += cycle_freed;
+    cycle_freed = 0;
+
+    page_release_empty();
+    scavenge();
+    pace_next_cycle();
+    check_fragmentation();
+}
+
+static void
+sweep_next_page() {
+    Page*  page = vm.unswept;
+    size_t before = vm.bytes_allocated;
+    vm.unswept = page->next_in_heap;
+    sweep_page(page);
+    cycle_freed += before - vm.bytes_allocated;
+
+    if (vm.unswept == NULL) {
+        finish_sweep();
+#ifdef DEBUG_LOG_GC
+        printf("-- gc sweep end, next at %zu\n", vm.next_gc);
+#endif
+    }
+}
+
+/// Sweep whatever a lazy sweep left behind, then clear the mark bitmaps so
+/// a new cycle can begin.
+static void
+begin_cycle() {
+    finish_lazy_sweep();
+
+    // A run that outgrew its budget goes on like any other, so its garbage
+    // can be reclaimed from here on.
+    arena_open = false;
+
+    page_clear_marks();
+
+    // Time spent before this point belongs to the last cycle.
+    pacer.cycle_start = now_us();
+    pacer.start_bytes = vm.bytes_allocated;
+    pacer.gc_time = 0;
+    pacer.marker_time = 0;
+    pacer.work_start = pacer.cycle_start;
+}
+
+static int
+run_sweep_worker(void* arg) {
+    current_sweeper = (Sweeper*)arg;
+
+    for (;;) {
+        int index = atomic_fetch_add(&next_sweep_page, 1);
+        if (index >= sweep_page_count)
+            break;
+        sweep_page(sweep_pages[index]);
+    }
+
+    current_sweeper = NULL;
+    return 0;
+}
+
+/// Sweep the pages with several threads. Each one sweeps whole pages, so
+/// they only share the index of the next page to take.
+///
+/// Returns:
+/// - bool: False when there was no memory for the list of pages, and
+///   nothing was swept.
+static bool
+sweep_parallel() {
+    int count = 0;
+    for (Page* page = page_heap(); page != NULL; page = page->next_in_heap)
+        count++;
+
+    free(sweep_pages);
+    sweep_pages = (Page**)malloc(sizeof(Page*) * count);
+    if (sweep_pages == NULL)
+        return false;
+
+    sweep_page_count = 0;
+    for (Page* page = page_heap(); page != NULL; page = page->next_in_heap)
+        sweep_pages[sweep_page_count++] = page;
+    atomic_store(&next_sweep_page, 0);
+
+    int thread_count = vm.gc_config.threads;
+    if (thread_count > count)
+        thread_count = count;
+
+    Sweeper sweepers[GC_MAX_THREADS] = {0};
+    bool    started[GC_MAX_THREADS] = {false};
+    for (int i = 1; i < thread_count; i++) {
+        started[i] = thrd_create(
+                         &sweepers[i].thread, run_sweep_worker, &sweepers[i])
+                     == thrd_success;
+    }
+
+    run_sweep_worker(&sweepers[0]);
+
+    for (int i = 0; i < thread_count; i++) {
+        if (started[i]) {
+            thrd_join(sweepers[i].thread, NULL);
+        }
+        vm.bytes_allocated -= sweepers[i].freed;
+
+        PageSlot* slot = sweepers[i].dead;
+        while (slot != NULL) {
+            PageSlot* next = slot->next;
+            page_free(slot);
+            slot = next;
+        }
+    }
+    return true;
+}
+
+static void
+sweep() {
+    size_t before = vm.bytes_allocated;
+    for_each_large_object(sweep_object);
+
+    if (vm.gc_config.threads <= 1 || !sweep_parallel()) {
+        for (Page* page = page_heap(); page != NULL;
+             page = page->next_in_heap) {
+            sweep_page(page);
+        }
+    }
+
+    cycle_freed += before - vm.bytes_allocated;
+    finish_sweep();
+}
+
+static uint64_t
+now_us() {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+/// Blacken gray objects until the worklist is empty or the deadline passes.
+///
+/// Params:
+/// - deadline: The time in microseconds at which to stop.
+///
+/// Returns:
+/// - bool: True when the worklist was drained.
+static bool
+trace_references_until(uint64_t deadline) {
+    int work = 0;
+    while (vm.gray_stack.count > 0) {
+        Obj* object = vm.gray_stack.objects[--vm.gray_stack.count];
+        blacken_object(object);
+
+        if (++work == GC_SLICE_CHECK_INTERVAL) {
+            work = 0;
+            if (now_us() >= deadline)
+                return vm.gray_stack.count == 0;
+        }
+    }
+    return true;
+}
+
+/// Mark the values of the weak map entries whose keys are marked, along
+/// with everything they reference. A value can make the key of another
+/// entry reachable, so this repeats until no entry changes (the ephemeron
+/// fixpoint). Runs once the strong references are all traced.
+static void
+trace_ephemerons() {
+    bool marked = true;
+    while (marked) {
+        marked = false;
+        for (ObjWeakMap* map = vm.weak_maps; map != NULL;
+             map = DEREF(ObjWeakMap, map->next_weak)) {
+            if (is_object_marked((Obj*)map)
+                && weak_table_mark_values(&map->table)) {
+                marked = true;
+            }
+        }
+
+        if (marked) {
+            trace_references();
+        }
+    }
+}
+
+/// Clear what weak references and weak map keys held that was not marked,
+/// and drop the weak objects that are garbage themselves from the lists of
+/// the vm. Runs before the sweep frees anything.
+static void
+clear_weak_references() {
+    ObjWeakRef* previous_ref = NULL;
+    ObjWeakRef* ref = vm.weak_refs;
+    while (ref != NULL) {
+        ObjWeakRef* next = DEREF(ObjWeakRef, ref->next_weak);
+        if (!is_object_marked((Obj*)ref)) {
+            if (previous_ref == NULL) {
+                vm.weak_refs = next;
+            } else {
+                previous_ref->next_weak = TO_REF(next);
+            }
+        } else {
+            if (IS_OBJ(ref->target) && !is_object_marked(AS_OBJ(ref->target))) {
+                ref->target = NIL_VAL;
+            }
+            previous_ref = ref;
+        }
+        ref = next;
+    }
+
+    ObjWeakMap* previous_map = NULL;
+    ObjWeakMap* map = vm.weak_maps;
+    while (map != NULL) {
+        ObjWeakMap* next = DEREF(ObjWeakMap, map->next_weak);
+        if (!is_object_marked((Obj*)map)) {
+            if (previous_map == NULL) {
+                vm.weak_maps = next;
+            } else {
+                previous_map->next_weak = TO_REF(next);
+            }
+        } else {
+            weak_table_remove_white(&map->table);
+            previous_map = map;
+        }
+        map = next;
+    }
+}
+
+static void
+reclaim_garbage() {
+#ifdef DEBUG_LOG_GC
+    size_t before = vm.bytes_allocated;
+#endif
+
+    trace_ephemerons();
+    clear_weak_references();
+    profile_sweep();
+    hashmap_remove_white(&vm.strings);
+    vm.gc_phase = GC_IDLE;
+
+    if (vm.gc_config.lazy_sweep && page_heap() != NULL) {
+        // The program sweeps a page on each allocation from here on, and
+        // the next threshold is set once the last one is done. Large
+        // objects are few and free whole pages, so they go at once.
+        size_t large_before = vm.bytes_allocated;
+        for_each_large_object(sweep_object);
+        cycle_freed += large_before - vm.bytes_allocated;
+        vm.unswept = page_heap();
+        return;
+    }
+
+    sweep();
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc end\n");
+    printf(
         "   collected %zu bytes (from %zu to %zu) next at %zu\n",
         before - vm.bytes_allocated,
         before,
         vm.bytes_allocated,
         vm.next_gc);
 #endif
-}
\ No newline at end of file
+}
+
+/// Finish marking an incremental cycle. The stack and globals are written
+/// without barriers, so they are scanned again before the cycle can end.
+static void
+remark() {
+    mark_roots();
+    trace_references();
+}
+
+/// Run one bounded slice of an incremental collection, starting a new cycle
+/// when none is in progress.
+static void
+gc_step() {
+    uint64_t deadline = now_us() + vm.gc_config.max_pause_us;
+    vm.gc_step_bytes = 0;
+
+    if (vm.gc_phase == GC_IDLE) {
+#ifdef DEBUG_LOG_GC
+        printf("-- gc begin (incremental)\n");
+#endif
+        begin_cycle();
+        vm.gc_phase = GC_MARKING;
+        mark_roots();
+    }
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc slice (%d gray)\n", vm.gray_stack.count);
+#endif
+
+    if (trace_references_until(deadline)) {
+        remark();
+        reclaim_garbage();
+    }
+}
+
+static int
+concurrent_mark(void* arg) {
+    (void)arg;
+    uint64_t start = now_us();
+    trace_references();
+    pacer.marker_time = now_us() - start;
+    atomic_store(&vm.marker_done, true);
+    return 0;
+}
+
+/// Scan the roots and hand the rest of the marking to a helper thread. The
+/// program only pauses again for the remark at the end of the cycle.
+static void
+start_concurrent_mark() {
+#ifdef DEBUG_LOG_GC
+    printf("-- gc begin (concurrent)\n");
+#endif
+
+    begin_cycle();
+    vm.gc_phase = GC_CONCURRENT;
+    atomic_store(&vm.marker_done, false);
+    mark_roots();
+
+    if (thrd_create(&vm.marker, concurrent_mark, NULL) != thrd_success) {
+        // Without a helper thread, finish the cycle right here.
+        vm.gc_phase = GC_MARKING;
+        collect_garbage();
+    }
+}
+
+/// Wait for the marker thread, then gray everything that was logged by the
+/// overwrite barrier so that the remark can trace it.
+static void
+finish_concurrent_mark() {
+    thrd_join(vm.marker, NULL);
+    pacer.gc_time += pacer.marker_time;
+    free_deferred();
+    vm.gc_phase = GC_MARKING;
+
+    for (int i = 0; i < vm.satb_log.count; i++) {
+        mark_object(vm.satb_log.objects[i]);
+    }
+    vm.satb_log.count = 0;
+}
+
+void
+collect_garbage() {
+#ifdef DEBUG_LOG_GC
+    printf("-- gc begin\n");
+#endif
+
+    if (vm.gc_phase == GC_CONCURRENT) {
+        finish_concurrent_mark();
+    }
+
+    if (vm.gc_phase == GC_IDLE) {
+        begin_cycle();
+        vm.gc_phase = GC_MARKING;
+        mark_roots();
+        trace_references();
+    } else {
+        remark();
+    }
+
+    reclaim_garbage();
+}
+
+void
+write_barrier(Obj* container, Value value) {
+    if (vm.gc_phase == GC_MARKING && is_object_marked(container)) {
+        mark_value(value);
+    }
+}
+
+void
+shade_object(Obj* object) {
+    if (vm.gc_phase == GC_MARKING) {
+        mark_object(object);
+        return;
+    }
+
+    // The marker thread owns the gray stack, so the object is logged for
+    // the remark instead. Reading the mark bit here races with the marker,
+    // which at worst logs an object that is already marked.
+    if (vm.gc_phase != GC_CONCURRENT || is_object_marked(object))
+        return;
+
+    push_gray_stack(&vm.satb_log, object);
+}
+
+void
+overwrite_barrier(Value old_value) {
+    if (vm.gc_phase == GC_CONCURRENT && IS_OBJ(old_value)) {
+        shade_object(AS_OBJ(old_value));
+    }
+}
+
+static void
+relocate_object(Obj* object) {
+    Obj* moved = (Obj*)page_relocate(object);
+    if (moved->type == OBJ_UPVALUE) {
+        // A closed upvalue points at its own closed slot.
+        ObjUpvalue* upvalue = (ObjUpvalue*)moved;
+        if (upvalue->location == &((ObjUpvalue*)object)->closed)
+            upvalue->location = &upvalue->closed;
+    }
+}
+
+// Forward a reference held in a field of a heap object.
+#define FORWARD_REF(type, ref)                                                 \
+    TO_REF((type*)forward_object((Obj*)DEREF(type, ref)))
+
+static void
+forward_array(ValueArray* array) {
+    for (int i = 0; i < array->count; i++) {
+        array->values[i] = forward_value(array->values[i]);
+    }
+}
+
+/// Update the references held by an object to the objects that moved.
+static void
+forward_references(Obj* object) {
+    switch (object->type) {
+        case OBJ_CLASS: {
+            ObjClass* klass = (ObjClass*)object;
+            klass->name = FORWARD_REF(ObjString, klass->name);
+            forward_hashmap(&klass->methods);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            ObjInstance* instance = (ObjInstance*)object;
+            instance->klass = FORWARD_REF(ObjClass, instance->klass);
+            forward_hashmap(&instance->fields);
+            break;
+        }
+        case OBJ_UPVALUE: {
+            ObjUpvalue* upvalue = (ObjUpvalue*)object;
+            upvalue->closed = forward_value(upvalue->closed);
+            upvalue->next = FORWARD_REF(ObjUpvalue, upvalue->next);
+            break;
+        }
+        case OBJ_FUNCTION: {
+            ObjFunction* function = (ObjFunction*)object;
+            function->name = FORWARD_REF(ObjString, function->name);
+            forward_array(&function->bytecode.constants);
+            break;
+        }
+        case OBJ_CLOSURE: {
+            ObjClosure* closure = (ObjClosure*)object;
+            closure->function = FORWARD_REF(ObjFunction, closure->function);
+            for (int i = 0; i < closure->upvalue_count; i++) {
+                closure->upvalues[i] =
+                    FORWARD_REF(ObjUpvalue, closure->upvalues[i]);
+            }
+            break;
+        }
+        case OBJ_BOUND_METHOD: {
+            ObjBoundMethod* bound = (ObjBoundMethod*)object;
+            bound->receiver = forward_value(bound->receiver);
+            bound->method = FORWARD_REF(ObjClosure, bound->method);
+            break;
+        }
+        case OBJ_WEAK_REF: {
+            ObjWeakRef* ref = (ObjWeakRef*)object;
+            ref->next_weak = FORWARD_REF(ObjWeakRef, ref->next_weak);
+            ref->target = forward_value(ref->target);
+            break;
+        }
+        case OBJ_WEAK_MAP: {
+            ObjWeakMap* map = (ObjWeakMap*)object;
+            map->next_weak = FORWARD_REF(ObjWeakMap, map->next_weak);
+            forward_weak_table(&map->table, weak_scratch);
+            break;
+        }
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)object;
+            rope->left = FORWARD_REF(Obj, rope->left);
+            rope->right = FORWARD_REF(Obj, rope->right);
+            break;
+        }
+        case OBJ_SLICE: {
+            ObjSlice* slice = (ObjSlice*)object;
+            slice->parent = FORWARD_REF(ObjString, slice->parent);
+            break;
+        }
+        case OBJ_NATIVE:
+        case OBJ_STRING:
+            break;
+    }
+}
+
+static void
+forward_roots() {
+    for (Value* slot = vm.stack; slot < vm.stack_top; slot++) {
+        *slot = forward_value(*slot);
+    }
+
+    for (int i = 0; i < vm.frame_count; i++) {
+        vm.frames[i].closure =
+            (ObjClosure*)forward_object((Obj*)vm.frames[i].closure);
+    }
+
+    forward_hashmap(&vm.globals);
+    forward_hashmap(&vm.strings);
+    forward_compiler_roots();
+    vm.init_string = (ObjString*)forward_object((Obj*)vm.init_string);
+    vm.open_upvalues = (ObjUpvalue*)forward_object((Obj*)vm.open_upvalues);
+    vm.weak_refs = (ObjWeakRef*)forward_object((Obj*)vm.weak_refs);
+    vm.weak_maps = (ObjWeakMap*)forward_object((Obj*)vm.weak_maps);
+}
+
+/// Reserve weak_scratch for the largest weak map.
+///
+/// Returns:
+/// - bool: False when there was no memory for it.
+static bool
+reserve_weak_scratch() {
+    int largest = 0;
+    for (ObjWeakMap* map = vm.weak_maps; map != NULL;
+         map = DEREF(ObjWeakMap, map->next_weak)) {
+        if (map->table.capacity > largest) {
+            largest = map->table.capacity;
+        }
+    }
+
+    weak_scratch = NULL;
+    if (largest == 0)
+        return true;
+    weak_scratch = (WeakEntry*)malloc(sizeof(WeakEntry) * (size_t)largest);
+    return weak_scratch != NULL;
+}
+
+static void
+compact() {
+    // Every object must be swept or known live, and no marker may be
+    // reading the heap while it moves.
+    if (vm.gc_phase != GC_IDLE || vm.unswept != NULL)
+        return;
+
+    // Nothing can be allocated once objects move, so what forwarding needs
+    // is reserved first. Without it the heap stays as it is.
+    if (!reserve_weak_scratch())
+        return;
+    if (!page_select_evacuation(GC_COMPACT_FREE_PERCENT)) {
+        free(weak_scratch);
+        weak_scratch = NULL;
+        return;
+    }
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc compact\n");
+#endif
+
+    // Pages added for the moved objects go in front of the first page, so
+    // the walk only meets the pages that were there before.
+    for (Page* page = page_heap(); page != NULL; page = page->next_in_heap) {
+        if (page->evacuating) {
+            for_each_object(page, relocate_object);
+        }
+    }
+
+    forward_roots();
+    profile_forward();
+    for (Page* page = page_heap(); page != NULL; page = page->next_in_heap) {
+        if (!page->evacuating) {
+            for_each_object(page, forward_references);
+        }
+    }
+    for_each_large_object(forward_references);
+
+    page_release_evacuated();
+    free(weak_scratch);
+    weak_scratch = NULL;
+}
+
+void
+compact_heap(void) {
+    vm.compact_pending = false;
+    run_gc_work(compact);
+}
+
+void
+init_gc_stats(GcStats* stats) {
+    memset(stats, 0, sizeof(GcStats));
+}
+
+const char*
+gc_pause_bucket_name(int bucket) {
+    static const char* names[GC_PAUSE_BUCKETS] = {
+        "under_10us",
+        "under_100us",
+        "under_1ms",
+        "under_10ms",
+        "under_100ms",
+        "over_100ms",
+    };
+    return names[bucket];
+}
+
+// The census that count_object adds to.
+static HeapCensus* census = NULL;
+
+static void
+count_object(Obj* object) {
+    census->counts[object->type]++;
+    census->bytes[object->type] += page_stride(page_of(object));
+}
+
+void
+for_each_heap_object(void (*visit)(Obj*)) {
+    if (vm.gc_phase == GC_IDLE) {
+        run_gc_work(finish_lazy_sweep);
+    }
+
+    for (Page* page = page_heap(); page != NULL; page = page->next_in_heap) {
+        for_each_object(page, visit);
+    }
+    for_each_large_object(visit);
+}
+
+void
+take_heap_census(HeapCensus* result) {
+    memset(result, 0, sizeof(HeapCensus));
+    census = result;
+    for_each_heap_object(count_object);
+    census = NULL;
+}
+
+void
+report_memory_statistics(void) {
+    const GcStats* stats = &vm.gc_stats;
+    HeapCensus     result;
+    take_heap_census(&result);
+
+    size_t used;
+    size_t reserved;
+    page_usage(&used, &reserved);
+
+    fprintf(stderr, "-- gc statistics\n");
+    fprintf(
+        stderr,
+        "   heap %zu bytes, next gc at %zu, pages %zu of %zu bytes used\n",
+        vm.bytes_allocated,
+        vm.next_gc,
+        used,
+        reserved);
+    fprintf(
+        stderr,
+        "   collections %" PRIu64 ", freed %zu bytes, %zu by the last\n",
+        stats->collections,
+        stats->total_freed,
+        stats->last_freed);
+    fprintf(
+        stderr,
+        "   pauses %" PRIu64 ", total %" PRIu64 " us, max %" PRIu64 " us\n",
+        stats->pauses,
+        stats->total_pause_us,
+        stats->max_pause_us);
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        fprintf(
+            stderr,
+            "     %-12s %" PRIu64 "\n",
+            gc_pause_bucket_name(i),
+            stats->histogram[i]);
+    }
+
+    fprintf(stderr, "   %-14s %10s %12s\n", "objects", "count", "bytes");
+    for (int type = 0; type < OBJ_TYPE_COUNT; type++) {
+        fprintf(
+            stderr,
+            "   %-14s %10zu %12zu\n",
+            object_type_name((ObjType)type),
+            result.counts[type],
+            result.bytes[type]);
+    }
+}
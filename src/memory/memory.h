@@ -6,7 +6,9 @@
 #pragma once
 
 #include "object.h"
+#include "page.h"
 #include "value.h"
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -14,6 +16,8 @@
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+#define FREE_OBJ(type, pointer) free_cell(pointer, sizeof(type))
+
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity) * 2)
 
 #define GROW_ARRAY(type, pointer, old_count, new_count)                        \
@@ -23,6 +27,84 @@
 #define FREE_ARRAY(type, pointer, old_count)                                   \
     reallocate(pointer, sizeof(type) * (old_count), 0)
 
+// The default time budget in microseconds for one incremental mark slice.
+#define GC_DEFAULT_MAX_PAUSE_US 500
+
+// The default spare page memory kept after a collection, as a percent of
+// the page memory in use. The rest goes back to the system.
+#define GC_DEFAULT_HEADROOM_PERCENT 100
+
+// The default share of the running time, in percent, that the gc aims to
+// take. The pacer spaces collections out to stay near it.
+#define GC_DEFAULT_CPU_PERCENT 10
+
+// The default heap size below which no collection starts.
+#define GC_DEFAULT_MIN_HEAP (1024 * 1024)
+
+// The most threads that can mark or sweep the heap in parallel.
+#define GC_MAX_THREADS 64
+
+// The number of buckets in the gc pause histogram. Bucket i counts the
+// pauses shorter than 10^(i + 1) microseconds that no earlier bucket
+// counts, and the last bucket counts the rest.
+#define GC_PAUSE_BUCKETS 6
+
+/// The phase of the current garbage collection cycle.
+typedef enum {
+    GC_IDLE,       // No collection is in progress.
+    GC_MARKING,    // Marking is interleaved with program execution.
+    GC_CONCURRENT, // A helper thread is marking alongside the program.
+} GcPhase;
+
+/// Settings that control how the garbage collector runs.
+typedef struct {
+    bool     incremental;      // When true, mark in bounded slices.
+    bool     concurrent;       // When true, mark on a helper thread.
+    bool     lazy_sweep;       // When true, sweep as the program allocates.
+    bool     compact;          // When true, compact a fragmented heap.
+    uint64_t max_pause_us;     // The time budget for a single mark slice.
+    int      threads;          // The number of threads that mark or sweep.
+    uint64_t headroom_percent; // The spare page memory kept, in percent.
+    uint64_t cpu_percent;      // The share of time the gc aims to take.
+    size_t   min_heap;         // The heap size below which no cycle starts.
+    size_t   max_heap;         // The heap size a cycle starts by, or 0.
+    size_t   heap_limit;       // The heap size no program may pass, or 0.
+    bool     arena;            // When true, drop the heap after each run.
+    size_t   arena_budget;     // The heap size an arena run starts gc by.
+} GcConfig;
+
+/// What the garbage collector has done since the vm started. A pause is any
+/// stretch of gc work the program waits for, such as a mark slice or the
+/// sweep of a page.
+typedef struct {
+    uint64_t collections;                 // Cycles that finished a sweep.
+    uint64_t pauses;                      // The number of pauses.
+    uint64_t total_pause_us;              // The time spent in pauses.
+    uint64_t max_pause_us;                // The longest pause.
+    uint64_t histogram[GC_PAUSE_BUCKETS]; // The pauses by length.
+    size_t   last_freed;                  // Bytes freed by the last cycle.
+    size_t   total_freed;                 // Bytes freed by every cycle.
+} GcStats;
+
+/// The objects of each type that are in the heap.
+typedef struct {
+    size_t counts[OBJ_TYPE_COUNT]; // The number of objects.
+    size_t bytes[OBJ_TYPE_COUNT];  // The heap memory they take up.
+} HeapCensus;
+
+/// A block whose release waits until marking ends.
+typedef struct {
+    void*  pointer; // The block to release.
+    size_t size;    // The size in bytes of the block.
+} DeferredFree;
+
+/// A growable stack of objects used as a gc worklist.
+typedef struct {
+    int   count;    // The number of objects on the stack.
+    int   capacity; // The total capacity of the stack.
+    Obj** objects;  // The objects waiting to be traced.
+} GrayStack;
+
 /// Reallocate memory. When old_size is 0, and new_size is non-zero,
 /// allocate. When new_size is 0 and old_size is non-zero, free.
 ///
@@ -36,10 +118,153 @@
 void*
 reallocate(void* pointer, size_t old_size, size_t new_size);
 
-/// Run the garbage collector to reclaim unused memory.
+/// Give up on an allocation that a full collection could not make room
+/// for. The running program stops with an error, or the process exits when
+/// there is none.
+///
+/// Params:
+/// - growth: The bytes the allocation added to the heap size, 0 for memory
+///   that the heap does not count.
+void
+fail_allocation(size_t growth);
+
+/// Allocate the memory for a heap object from a size-class page, or from a
+/// page of its own when it is large.
+///
+/// Params:
+/// - size: The size in bytes of the object.
+///
+/// Returns:
+/// - void*: A pointer to the memory for the object.
+void*
+allocate_cell(size_t size);
+
+/// Free the memory of a heap object allocated with allocate_cell.
+///
+/// Params:
+/// - pointer: The memory of the object.
+/// - size: The size in bytes that was passed to allocate_cell.
+void
+free_cell(void* pointer, size_t size);
+
+/// Initialize the garbage collector settings to their defaults.
+///
+/// Params:
+/// - config: The settings to initialize.
+void
+init_gc_config(GcConfig* config);
+
+/// Put the gc settings into effect once they are final. Until then the
+/// collector runs with the defaults. A min_heap above max_heap is lowered
+/// to it.
+void
+apply_gc_config(void);
+
+/// Initialize the garbage collector statistics to zero.
+///
+/// Params:
+/// - stats: The statistics to initialize.
+void
+init_gc_stats(GcStats* stats);
+
+/// Get the name of a bucket of the gc pause histogram, such as
+/// "under_1ms".
+///
+/// Params:
+/// - bucket: The index of the bucket.
+///
+/// Returns:
+/// - const char*: The name of the bucket.
+const char*
+gc_pause_bucket_name(int bucket);
+
+/// Call a function on every object in the heap. A pending lazy sweep is
+/// finished first so that the garbage it would free is not visited. While
+/// a cycle is marking, garbage it has not found yet is visited.
+///
+/// Params:
+/// - visit: The function to call. It must not allocate.
+void
+for_each_heap_object(void (*visit)(Obj*));
+
+/// Count the objects in the heap by type, visiting them as
+/// for_each_heap_object does.
+///
+/// Params:
+/// - census: Set to the objects of each type.
+void
+take_heap_census(HeapCensus* census);
+
+/// Initialize an empty gc worklist.
+///
+/// Params:
+/// - stack: The worklist to initialize.
+void
+init_gray_stack(GrayStack* stack);
+
+/// Move the objects out of sparse pages and release those pages. Object
+/// addresses change, so this may only run at a safepoint in the run loop,
+/// where no C local holds a heap pointer.
+void
+compact_heap(void);
+
+/// Get the current address of an object that a compaction may have moved.
+///
+/// Params:
+/// - object: The object, or NULL.
+///
+/// Returns:
+/// - Obj*: The address the object lives at now.
+static inline Obj*
+forward_object(Obj* object) {
+    return object == NULL ? NULL : (Obj*)page_forward(object);
+}
+
+/// Get a value with its object reference forwarded by forward_object.
+///
+/// Params:
+/// - value: The value to forward.
+///
+/// Returns:
+/// - Value: The value with the current object address.
+static inline Value
+forward_value(Value value) {
+    return IS_OBJ(value) ? OBJ_VAL(forward_object(AS_OBJ(value))) : value;
+}
+
+/// Run the garbage collector to reclaim unused memory. When an incremental
+/// cycle is already in progress, it is finished without interruption.
 void
 collect_garbage();
 
+/// Record that a reference to value was stored inside of container. While
+/// an incremental cycle is marking, this keeps a scanned (black) object from
+/// pointing at an unmarked (white) one.
+///
+/// Params:
+/// - container: The object that now holds the reference.
+/// - value: The value that was stored.
+void
+write_barrier(Obj* container, Value value);
+
+/// Keep an object alive through the current gc cycle even though it may not
+/// have been reachable so far. Used when a weakly held object, such as an
+/// interned string, is handed back to the program.
+///
+/// Params:
+/// - object: The object to keep alive.
+void
+shade_object(Obj* object);
+
+/// Record that a reference is about to be overwritten. While a helper thread
+/// is marking, the old value is logged so that everything reachable when
+/// the cycle began survives it (snapshot-at-the-beginning).
+///
+/// Params:
+/// - old_value: The value that is about to be replaced.
+void
+overwrite_barrier(Value old_value);
+
 /// Mark a value as reachable so it's not collected.
 ///
 /// Params:
@@ -54,10 +279,44 @@ mark_value(Value value);
 void
 mark_object(Obj* object);
 
+/// Push an already marked object onto the gc worklist so that its references
+/// are traced.
+///
+/// Params:
+/// - object: The object to trace.
+void
+gray_object(Obj* object);
+
+/// Check whether the gc has marked an object as reachable.
+///
+/// Params:
+/// - object: The object to check.
+///
+/// Returns:
+/// - bool: True when the object is marked.
+static inline bool
+is_object_marked(Obj* object) {
+    return page_is_marked(object);
+}
+
+/// Set the mark bit of an object.
+///
+/// Params:
+/// - object: The object to mark.
+///
+/// Returns:
+/// - bool: True when this call marked the object, false when another call
+///   already had.
+static inline bool
+set_object_marked(Obj* object) {
+    return page_set_marked(object);
+}
+
 /// Free all objects that were allocated.
 void
 free_objects(void);
 
-/// Report memory statistics and usage.
+/// Print the heap size, the gc statistics and a census of the heap to
+/// stderr.
 void
 report_memory_statistics(void);
@@ -0,0 +1,593 @@
+// File:    page.c
+// Purpose: Implement page.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "page.h"
+#include "large.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifdef HEAP_CAGE
+#include "cage.h"
+#endif
+
+/// The pages of one size class that still have a free slot. Full pages are
+/// only reachable through their slots until one of them is freed.
+static Page* available_pages[SIZE_CLASS_COUNT];
+
+/// Every page of every size class.
+static Page* heap_pages = NULL;
+
+/// The pages that each hold a single large block. They are kept apart so
+/// that a sweep of the small pages never has to step over them.
+static Page* large_pages = NULL;
+
+/// Small pages that emptied and were set aside for reuse, linked through
+/// next. Their memory is still in place.
+static Page*  idle_pages = NULL;
+static size_t idle_count = 0;
+
+/// Idle pages whose memory was handed back to the system. Their headers
+/// went with it, so they are kept in an array rather than linked.
+static Page** scavenged_pages = NULL;
+static size_t scavenged_count = 0;
+static size_t scavenged_capacity = 0;
+
+/// The bytes handed back to the system by page_scavenge so far.
+static size_t scavenged_bytes = 0;
+
+#ifdef HEAP_CAGE
+
+#ifdef _WIN32
+#error "HEAP_CAGE needs mmap and is not supported on Windows."
+#endif
+
+char* heap_cage_base = NULL;
+
+/// The end of the part of the cage that has ever been handed out.
+static char* cage_top = NULL;
+
+/// A run of pages in the cage that was handed out and then released.
+typedef struct CageRun {
+    struct CageRun* next; // The next free run, at a higher address.
+    char*           start; // The first byte of the run.
+    size_t          size;  // The bytes in the run, a multiple of PAGE_SIZE.
+} CageRun;
+
+/// The free runs of the cage, sorted by address.
+static CageRun* cage_runs = NULL;
+
+static void
+reserve_cage(void) {
+    void* base = mmap(
+        NULL,
+        HEAP_CAGE_SIZE,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1,
+        0);
+    if (base == MAP_FAILED)
+        exit(1);
+
+    heap_cage_base = (char*)base;
+    uintptr_t first = ((uintptr_t)base + PAGE_SIZE - 1)
+                      & ~(uintptr_t)(PAGE_SIZE - 1);
+    cage_top = (char*)first;
+}
+
+/// Take a run for a page from the cage. A page of a size class is exactly
+/// PAGE_SIZE, so mid-size blocks share the run of their class. Only the page
+/// of a block over PAGE_MAX_SLOT is longer, and its run is rounded up to
+/// whole pages to keep the runs aligned.
+static void*
+allocate_aligned_page(size_t size) {
+    if (heap_cage_base == NULL) {
+        reserve_cage();
+    }
+
+    size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    for (CageRun** link = &cage_runs; *link != NULL; link = &(*link)->next) {
+        CageRun* run = *link;
+        if (run->size < size)
+            continue;
+
+        char* start = run->start;
+        run->start += size;
+        run->size -= size;
+        if (run->size == 0) {
+            *link = run->next;
+            free(run);
+        }
+        return start;
+    }
+
+    if (cage_top + size > heap_cage_base + HEAP_CAGE_SIZE)
+        return NULL;
+
+    char* start = cage_top;
+    cage_top += size;
+    return start;
+}
+
+/// Give the memory of a run back to the system and put the run on the free
+/// list, merging it with the runs on either side.
+static void
+free_aligned_page(void* start, size_t size) {
+    size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    madvise(start, size, MADV_DONTNEED);
+
+    CageRun*  previous = NULL;
+    CageRun** link = &cage_runs;
+    while (*link != NULL && (*link)->start < (char*)start) {
+        previous = *link;
+        link = &(*link)->next;
+    }
+
+    CageRun* next = *link;
+    if (previous != NULL && previous->start + previous->size == start) {
+        previous->size += size;
+        if (next != NULL && previous->start + previous->size == next->start) {
+            previous->size += next->size;
+            previous->next = next->next;
+            free(next);
+        }
+        return;
+    }
+
+    if (next != NULL && (char*)start + size == next->start) {
+        next->start = (char*)start;
+        next->size += size;
+        return;
+    }
+
+    CageRun* run = (CageRun*)malloc(sizeof(CageRun));
+    if (run == NULL)
+        exit(1);
+    run->start = (char*)start;
+    run->size = size;
+    run->next = next;
+    *link = run;
+}
+
+#else
+
+static void*
+allocate_aligned_page(size_t size) {
+    if (size > LARGE_BLOCK_THRESHOLD)
+        return large_map(size, PAGE_SIZE);
+
+#ifdef _WIN32
+    return _aligned_malloc(size, PAGE_SIZE);
+#else
+    void* page;
+    if (posix_memalign(&page, PAGE_SIZE, size) != 0)
+        return NULL;
+    return page;
+#endif
+}
+
+static void
+free_aligned_page(void* start, size_t size) {
+    if (size > LARGE_BLOCK_THRESHOLD) {
+        large_unmap(start, size);
+        return;
+    }
+
+#ifdef _WIN32
+    _aligned_free(start);
+#else
+    free(start);
+#endif
+}
+
+#endif
+
+/// Get the bytes taken up by a page, including the slot of a large page.
+static size_t
+page_footprint(Page* page) {
+    if (page->size_class != PAGE_LARGE_CLASS)
+        return PAGE_SIZE;
+    return (size_t)(page->unused - (char*)page);
+}
+
+/// Get the list a page belongs on.
+static Page**
+page_list(Page* page) {
+    return page->size_class == PAGE_LARGE_CLASS ? &large_pages : &heap_pages;
+}
+
+static void
+unlink_page(Page* page) {
+    if (page->previous_in_heap != NULL) {
+        page->previous_in_heap->next_in_heap = page->next_in_heap;
+    } else {
+        *page_list(page) = page->next_in_heap;
+    }
+
+    if (page->next_in_heap != NULL) {
+        page->next_in_heap->previous_in_heap = page->previous_in_heap;
+    }
+}
+
+static void
+release_page(Page* page) {
+    unlink_page(page);
+    free_aligned_page(page, page_footprint(page));
+}
+
+static void
+link_available(Page* page) {
+    Page** head = &available_pages[page->size_class];
+    page->previous = NULL;
+    page->next = *head;
+    if (*head != NULL) {
+        (*head)->previous = page;
+    }
+    *head = page;
+    page->available = true;
+}
+
+static void
+unlink_available(Page* page) {
+    if (page->previous != NULL) {
+        page->previous->next = page->next;
+    } else {
+        available_pages[page->size_class] = page->next;
+    }
+
+    if (page->next != NULL) {
+        page->next->previous = page->previous;
+    }
+
+    page->next = NULL;
+    page->previous = NULL;
+    page->available = false;
+}
+
+/// Take an empty small page out of the heap and set it aside for reuse.
+static void
+retire_page(Page* page) {
+    if (page->available) {
+        unlink_available(page);
+    }
+    unlink_page(page);
+
+    page->next = idle_pages;
+    idle_pages = page;
+    idle_count++;
+}
+
+/// Get a page set aside by retire_page, preferring one whose memory is
+/// still in place.
+static Page*
+take_idle_page(void) {
+    if (idle_pages != NULL) {
+        Page* page = idle_pages;
+        idle_pages = page->next;
+        idle_count--;
+        return page;
+    }
+
+    if (scavenged_count > 0)
+        return scavenged_pages[--scavenged_count];
+    return NULL;
+}
+
+/// Hand the memory of a page back to the system while keeping its address
+/// range. The memory reads as zeros, or as garbage on Windows, once it is
+/// touched again.
+static void
+decommit_page(Page* page) {
+#ifdef _WIN32
+    VirtualAlloc(page, PAGE_SIZE, MEM_RESET, PAGE_READWRITE);
+#else
+    madvise(page, PAGE_SIZE, MADV_DONTNEED);
+#endif
+}
+
+/// Get the number of entries in the bitmaps of a page.
+static size_t
+page_bitmap_words(Page* page) {
+    return page->size_class == PAGE_LARGE_CLASS ? 1 : PAGE_BITMAP_WORDS;
+}
+
+static Page*
+new_page(int size_class, size_t size) {
+    Page* page = size_class == PAGE_LARGE_CLASS ? NULL : take_idle_page();
+    if (page == NULL) {
+        page = (Page*)allocate_aligned_page(size);
+    }
+    if (page == NULL)
+        return NULL;
+
+    page->next = NULL;
+    page->previous = NULL;
+    page->free = NULL;
+    page->size_class = size_class;
+    page->unused = page_first_slot(page);
+    page->live = 0;
+    page->available = false;
+    page->evacuating = false;
+    memset((void*)page->bits, 0, sizeof(PageBits) * page_bitmap_words(page));
+
+    Page** list = page_list(page);
+    page->previous_in_heap = NULL;
+    page->next_in_heap = *list;
+    if (*list != NULL) {
+        (*list)->previous_in_heap = page;
+    }
+    *list = page;
+
+    return page;
+}
+
+/// Determine whether a page has handed out every slot it holds.
+static bool
+is_page_full(Page* page) {
+    size_t slot_size = page_class_slot_size(page->size_class);
+    return page->free == NULL
+           && page->unused + slot_size > (char*)page + PAGE_SIZE;
+}
+
+static void
+set_allocated(Page* page, void* slot, bool allocated) {
+    size_t   index = page_slot_index(slot);
+    uint64_t mask = (uint64_t)1 << (index % 64);
+    if (allocated) {
+        page->bits[index / 64].allocated |= mask;
+    } else {
+        page->bits[index / 64].allocated &= ~mask;
+    }
+}
+
+void*
+page_allocate(size_t size) {
+    size = page_slot_size(size);
+    if (size > PAGE_MAX_SLOT) {
+        Page* page =
+            new_page(PAGE_LARGE_CLASS, PAGE_LARGE_HEADER_SIZE + size);
+        if (page == NULL)
+            return NULL;
+
+        void* slot = page->unused;
+        page->unused += size;
+        page->live = 1;
+        set_allocated(page, slot, true);
+        return slot;
+    }
+
+    int   size_class = page_size_class(size);
+    Page* page = available_pages[size_class];
+    if (page == NULL) {
+        page = new_page(size_class, PAGE_SIZE);
+        if (page == NULL)
+            return NULL;
+        link_available(page);
+    }
+
+    void* slot;
+    if (page->free != NULL) {
+        slot = page->free;
+        page->free = page->free->next;
+    } else {
+        slot = page->unused;
+        page->unused += size;
+    }
+
+    page->live++;
+    set_allocated(page, slot, true);
+    if (is_page_full(page)) {
+        unlink_available(page);
+    }
+
+    return slot;
+}
+
+void
+page_free(void* pointer) {
+    Page* page = page_of(pointer);
+    page->live--;
+    set_allocated(page, pointer, false);
+    if (page->size_class == PAGE_LARGE_CLASS) {
+        release_page(page);
+        return;
+    }
+
+    PageSlot* slot = (PageSlot*)pointer;
+    slot->next = page->free;
+    page->free = slot;
+
+    if (!page->available && !page->evacuating) {
+        link_available(page);
+    }
+}
+
+Page*
+page_heap(void) {
+    return heap_pages;
+}
+
+Page*
+page_large_objects(void) {
+    return large_pages;
+}
+
+void
+page_release_empty(void) {
+    bool kept[SIZE_CLASS_COUNT] = {false};
+
+    Page* page = heap_pages;
+    while (page != NULL) {
+        Page* next = page->next_in_heap;
+        if (page->live == 0) {
+            if (kept[page->size_class]) {
+                retire_page(page);
+            } else {
+                kept[page->size_class] = true;
+            }
+        }
+        page = next;
+    }
+}
+
+static size_t
+page_capacity(Page* page) {
+    return PAGE_MAX_SLOT / page_class_slot_size(page->size_class);
+}
+
+size_t
+page_scavenge(size_t retain) {
+    size_t released = 0;
+    while (idle_pages != NULL && idle_count * PAGE_SIZE > retain) {
+        if (scavenged_count == scavenged_capacity) {
+            size_t capacity =
+                scavenged_capacity < 8 ? 8 : scavenged_capacity * 2;
+            Page** pages =
+                (Page**)realloc(scavenged_pages, sizeof(Page*) * capacity);
+            if (pages == NULL)
+                break;
+            scavenged_pages = pages;
+            scavenged_capacity = capacity;
+        }
+
+        Page* page = idle_pages;
+        idle_pages = page->next;
+        idle_count--;
+
+        decommit_page(page);
+        scavenged_pages[scavenged_count++] = page;
+        released += PAGE_SIZE;
+    }
+
+    scavenged_bytes += released;
+    return released;
+}
+
+size_t
+page_scavenged_bytes(void) {
+    return scavenged_bytes;
+}
+
+void
+page_usage(size_t* used, size_t* reserved) {
+    *used = 0;
+    *reserved = 0;
+    for (Page* page = heap_pages; page != NULL; page = page->next_in_heap) {
+        size_t slot_size = page_class_slot_size(page->size_class);
+        *used += page->live * slot_size;
+        *reserved += page_capacity(page) * slot_size;
+    }
+}
+
+static bool
+is_page_sparse(Page* page, int max_live_percent) {
+    return (size_t)page->live * 100
+           < page_capacity(page) * (size_t)max_live_percent;
+}
+
+bool
+page_select_evacuation(int max_live_percent) {
+    // A lone sparse page would only move into a new page of its own.
+    int sparse_counts[SIZE_CLASS_COUNT] = {0};
+    for (Page* page = heap_pages; page != NULL; page = page->next_in_heap) {
+        if (is_page_sparse(page, max_live_percent)) {
+            sparse_counts[page->size_class]++;
+        }
+    }
+
+    bool selected = false;
+    for (Page* page = heap_pages; page != NULL; page = page->next_in_heap) {
+        if (!is_page_sparse(page, max_live_percent)
+            || sparse_counts[page->size_class] < 2) {
+            continue;
+        }
+
+        if (page->available) {
+            unlink_available(page);
+        }
+        page->evacuating = true;
+        selected = true;
+    }
+
+    return selected;
+}
+
+void*
+page_relocate(void* pointer) {
+    Page*  from = page_of(pointer);
+    size_t slot_size = page_class_slot_size(from->size_class);
+    void*  to = page_allocate(slot_size);
+    // Half the objects may have moved already and cannot be put back, so
+    // running out of memory here still exits.
+    if (to == NULL)
+        exit(1);
+
+    memcpy(to, pointer, slot_size);
+    ((PageSlot*)pointer)->next = (PageSlot*)to;
+    from->live--;
+    set_allocated(from, pointer, false);
+    return to;
+}
+
+void
+page_release_evacuated(void) {
+    Page* page = heap_pages;
+    while (page != NULL) {
+        Page* next = page->next_in_heap;
+        if (page->evacuating) {
+            retire_page(page);
+        }
+        page = next;
+    }
+}
+
+void
+page_clear_marks(void) {
+    for (Page* page = heap_pages; page != NULL; page = page->next_in_heap) {
+        for (size_t i = 0; i < PAGE_BITMAP_WORDS; i++) {
+            atomic_store_explicit(
+                &page->bits[i].marks, 0, memory_order_relaxed);
+        }
+    }
+
+    for (Page* page = large_pages; page != NULL; page = page->next_in_heap) {
+        atomic_store_explicit(&page->bits[0].marks, 0, memory_order_relaxed);
+    }
+}
+
+void
+free_pages(void) {
+    while (heap_pages != NULL) {
+        Page* page = heap_pages;
+        if (page->available) {
+            unlink_available(page);
+        }
+        release_page(page);
+    }
+
+    while (large_pages != NULL) {
+        release_page(large_pages);
+    }
+
+    while (idle_pages != NULL) {
+        Page* page = idle_pages;
+        idle_pages = page->next;
+        free_aligned_page(page, PAGE_SIZE);
+    }
+    idle_count = 0;
+
+    while (scavenged_count > 0) {
+        free_aligned_page(scavenged_pages[--scavenged_count], PAGE_SIZE);
+    }
+    free(scavenged_pages);
+    scavenged_pages = NULL;
+    scavenged_capacity = 0;
+}
@@ -0,0 +1,367 @@
+// File:    page.h
+// Purpose: Definitions for the size-class page allocator used for objects.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The size of a page in bytes. Pages are aligned to their size, so the page
+// that holds a slot is found by masking the slot address.
+#define PAGE_SIZE (64 * 1024)
+
+// The spacing between the fine size classes, which is also the smallest
+// slot.
+#define PAGE_SLOT_ALIGN 16
+
+// The largest slot of the fine size classes. Above it the classes double,
+// so a mid-size block wastes at most half of its slot.
+#define PAGE_FINE_MAX_SLOT 256
+
+// The number of fine size classes.
+#define PAGE_FINE_CLASS_COUNT (PAGE_FINE_MAX_SLOT / PAGE_SLOT_ALIGN)
+
+// The number of coarse size classes: powers of two from 512 bytes to 16 KiB,
+// then the largest slots that fit two and one to a page.
+#define PAGE_COARSE_CLASS_COUNT 8
+
+// The number of size classes.
+#define SIZE_CLASS_COUNT (PAGE_FINE_CLASS_COUNT + PAGE_COARSE_CLASS_COUNT)
+
+// The largest slot that is shared with others in a page. A larger block
+// gets a large page of its own.
+#define PAGE_MAX_SLOT (PAGE_SIZE - PAGE_HEADER_SIZE)
+
+// The size class of a page that holds a single large block.
+#define PAGE_LARGE_CLASS -1
+
+// The number of words in a page bitmap, one bit per slot position.
+#define PAGE_BITMAP_WORDS (PAGE_SIZE / PAGE_SLOT_ALIGN / 64)
+
+// Round a size up to a multiple of PAGE_SLOT_ALIGN.
+#define PAGE_ALIGN_UP(size)                                                    \
+    (((size) + PAGE_SLOT_ALIGN - 1) & ~(size_t)(PAGE_SLOT_ALIGN - 1))
+
+// The offset of the first slot of a small page, past the page header.
+#define PAGE_HEADER_SIZE                                                       \
+    PAGE_ALIGN_UP(sizeof(Page) + sizeof(PageBits) * PAGE_BITMAP_WORDS)
+
+// The offset of the slot of a large page. The slot lies within the first 64
+// slot positions, so the header only needs the first word of each bitmap.
+#define PAGE_LARGE_HEADER_SIZE PAGE_ALIGN_UP(sizeof(Page) + sizeof(PageBits))
+
+/// A slot that is not in use, linked into the free list of its page.
+typedef struct PageSlot {
+    struct PageSlot* next; // The next free slot in the same page.
+} PageSlot;
+
+/// The bits of 64 slot positions in a page.
+typedef struct {
+    uint64_t         allocated; // The bit of each slot that is in use.
+    _Atomic uint64_t marks;     // The mark bit of each slot, set by the gc.
+} PageBits;
+
+/// The header at the start of every page. All slots in a page have the size
+/// of its size class. The mark bits of the slots live here rather than in
+/// the objects, so marking and sweeping leave the objects untouched. The
+/// allocation bits let the gc walk the objects of a page.
+typedef struct Page {
+    struct Page*     next;             // The next page with room in the class.
+    struct Page*     previous;         // The previous page with room.
+    struct Page*     next_in_heap;     // The next page of any class.
+    struct Page*     previous_in_heap; // The previous page of any class.
+    PageSlot*        free;             // Slots that were used and then freed.
+    char*            unused;           // The first slot never handed out.
+    int              size_class;       // The size class index, or large.
+    int              live;             // The number of slots in use.
+    bool             available;        // When true, it is on its class list.
+    bool             evacuating;       // When true, its slots are moving.
+
+    // The bitmaps, one entry per 64 slot positions. A small page has
+    // PAGE_BITMAP_WORDS of them and a large page only the first.
+    PageBits bits[];
+} Page;
+
+/// Get the size of the slots of a size class.
+///
+/// Params:
+/// - size_class: The index of the size class.
+///
+/// Returns:
+/// - size_t: The slot size in bytes.
+static inline size_t
+page_class_slot_size(int size_class) {
+    if (size_class < PAGE_FINE_CLASS_COUNT)
+        return (size_t)(size_class + 1) * PAGE_SLOT_ALIGN;
+
+    int coarse = size_class - PAGE_FINE_CLASS_COUNT;
+    if (coarse < PAGE_COARSE_CLASS_COUNT - 2)
+        return (size_t)PAGE_FINE_MAX_SLOT << (coarse + 1);
+
+    // A header takes the front of each page, so the last two classes are
+    // a little under 32 and 64 KiB.
+    int slots = SIZE_CLASS_COUNT - size_class;
+    return (PAGE_MAX_SLOT / slots) & ~(size_t)(PAGE_SLOT_ALIGN - 1);
+}
+
+/// Get the size class of the slot that holds a block.
+///
+/// Params:
+/// - size: The size in bytes of the block, at most PAGE_MAX_SLOT.
+///
+/// Returns:
+/// - int: The index of the size class.
+static inline int
+page_size_class(size_t size) {
+    if (size <= PAGE_FINE_MAX_SLOT)
+        return size == 0 ? 0 : (int)((size - 1) / PAGE_SLOT_ALIGN);
+
+    int size_class = PAGE_FINE_CLASS_COUNT;
+    while (page_class_slot_size(size_class) < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+/// Get the size of the slot that holds a block of this size.
+///
+/// Params:
+/// - size: The size in bytes of the block.
+///
+/// Returns:
+/// - size_t: The slot size of its size class, or the block size rounded up
+///   to a multiple of PAGE_SLOT_ALIGN when it gets a large page.
+static inline size_t
+page_slot_size(size_t size) {
+    size_t rounded = PAGE_ALIGN_UP(size);
+    if (rounded <= PAGE_FINE_MAX_SLOT || rounded > PAGE_MAX_SLOT)
+        return rounded;
+    return page_class_slot_size(page_size_class(rounded));
+}
+
+/// Get the page that holds a slot.
+///
+/// Params:
+/// - pointer: A slot handed out by page_allocate.
+///
+/// Returns:
+/// - Page*: The page that contains the slot.
+static inline Page*
+page_of(void* pointer) {
+    return (Page*)((uintptr_t)pointer & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+/// Get the bit position of a slot in the bitmaps of its page.
+static inline size_t
+page_slot_index(void* pointer) {
+    return ((uintptr_t)pointer & (PAGE_SIZE - 1)) / PAGE_SLOT_ALIGN;
+}
+
+/// Get the word of the mark bitmap that holds the bit of a slot, along with
+/// the mask of that bit.
+static inline _Atomic uint64_t*
+page_mark_word(void* pointer, uint64_t* mask) {
+    size_t index = page_slot_index(pointer);
+    *mask = (uint64_t)1 << (index % 64);
+    return &page_of(pointer)->bits[index / 64].marks;
+}
+
+/// Check whether a slot holds a block that is in use.
+///
+/// Params:
+/// - pointer: A slot in a page.
+///
+/// Returns:
+/// - bool: True when the slot was handed out and not yet freed.
+static inline bool
+page_is_allocated(void* pointer) {
+    size_t index = page_slot_index(pointer);
+    return (page_of(pointer)->bits[index / 64].allocated >> (index % 64)) & 1;
+}
+
+/// Get the first slot of a page.
+static inline char*
+page_first_slot(Page* page) {
+    if (page->size_class < 0) {
+        return (char*)page + PAGE_LARGE_HEADER_SIZE;
+    }
+    return (char*)page + PAGE_HEADER_SIZE;
+}
+
+/// Get the distance between the slots of a page. The slots that were ever
+/// handed out lie between page_first_slot and page->unused.
+static inline size_t
+page_stride(Page* page) {
+    if (page->size_class < 0) {
+        return (size_t)(page->unused - page_first_slot(page));
+    }
+    return page_class_slot_size(page->size_class);
+}
+
+/// Check the mark bit of a slot.
+///
+/// Params:
+/// - pointer: A slot handed out by page_allocate.
+///
+/// Returns:
+/// - bool: True when the slot is marked.
+static inline bool
+page_is_marked(void* pointer) {
+    uint64_t          mask;
+    _Atomic uint64_t* word = page_mark_word(pointer, &mask);
+    return (atomic_load_explicit(word, memory_order_relaxed) & mask) != 0;
+}
+
+/// Set the mark bit of a slot. Other threads may be marking slots that
+/// share the word, so the bit is set with an atomic or.
+///
+/// Params:
+/// - pointer: A slot handed out by page_allocate.
+///
+/// Returns:
+/// - bool: True when this call set the bit, false when it was already set.
+static inline bool
+page_set_marked(void* pointer) {
+    uint64_t          mask;
+    _Atomic uint64_t* word = page_mark_word(pointer, &mask);
+    return (atomic_fetch_or_explicit(word, mask, memory_order_relaxed) & mask)
+           == 0;
+}
+
+/// Clear the mark bit of a slot.
+///
+/// Params:
+/// - pointer: A slot handed out by page_allocate.
+static inline void
+page_clear_marked(void* pointer) {
+    uint64_t          mask;
+    _Atomic uint64_t* word = page_mark_word(pointer, &mask);
+    atomic_fetch_and_explicit(word, ~mask, memory_order_relaxed);
+}
+
+/// Get the current address of a slot that may have been moved out of an
+/// evacuating page.
+///
+/// Params:
+/// - pointer: A slot handed out by page_allocate.
+///
+/// Returns:
+/// - void*: The slot the block now lives in.
+static inline void*
+page_forward(void* pointer) {
+    if (page_of(pointer)->evacuating) {
+        return ((PageSlot*)pointer)->next;
+    }
+    return pointer;
+}
+
+/// Take a free slot for a block. Blocks up to PAGE_MAX_SLOT come from a page
+/// of their size class, which gains a page when all of its pages are full.
+/// A larger block gets a page of its own, mapped straight from the system
+/// when it is bigger than LARGE_BLOCK_THRESHOLD.
+///
+/// Params:
+/// - size: The size in bytes of the block.
+///
+/// Returns:
+/// - void*: The slot, or NULL when the system is out of memory.
+void*
+page_allocate(size_t size);
+
+/// Return a slot to its page. A small page that empties stays in place until
+/// page_release_empty, so walking the heap while freeing is safe. The page
+/// of a large block is released at once.
+///
+/// Params:
+/// - pointer: A slot handed out by page_allocate.
+void
+page_free(void* pointer);
+
+/// Get the first page of the heap. The rest follow through next_in_heap,
+/// newest first. Large pages are not among them.
+///
+/// Returns:
+/// - Page*: The newest page, or NULL when there are none.
+Page*
+page_heap(void);
+
+/// Get the first page that holds a large block. The rest follow through
+/// next_in_heap, newest first. Each holds one block in its first slot.
+///
+/// Returns:
+/// - Page*: The newest large page, or NULL when there are none.
+Page*
+page_large_objects(void);
+
+/// Set aside the pages that hold no slot in use, keeping one page per size
+/// class in place so a class that shrinks and grows around a page boundary
+/// does not keep asking for new pages. Pages set aside are reused before
+/// any new page is allocated.
+void
+page_release_empty(void);
+
+/// Hand the memory of pages set aside for reuse back to the system, until
+/// no more than a given amount of it is left in place. The pages keep their
+/// addresses and can still be reused.
+///
+/// Params:
+/// - retain: The bytes of idle page memory to keep in place.
+///
+/// Returns:
+/// - size_t: The bytes handed back.
+size_t
+page_scavenge(size_t retain);
+
+/// Get the bytes handed back to the system by page_scavenge so far.
+///
+/// Returns:
+/// - size_t: The total, which only grows.
+size_t
+page_scavenged_bytes(void);
+
+/// Measure how much of the small-object pages is in use.
+///
+/// Params:
+/// - used: Set to the bytes held by slots in use.
+/// - reserved: Set to the bytes the pages can hold in slots.
+void
+page_usage(size_t* used, size_t* reserved);
+
+/// Pick the pages to empty in a compaction: those whose use is below a
+/// share of their capacity, in classes that have more than one such page.
+/// No slot is handed out from them until they are released.
+///
+/// Params:
+/// - max_live_percent: The share of slots in use below which a page moves.
+///
+/// Returns:
+/// - bool: True when any page was picked.
+bool
+page_select_evacuation(int max_live_percent);
+
+/// Copy a block out of an evacuating page into a new slot of its class,
+/// leaving the new address behind for page_forward.
+///
+/// Params:
+/// - pointer: A slot in an evacuating page.
+///
+/// Returns:
+/// - void*: The new slot.
+void*
+page_relocate(void* pointer);
+
+/// Set aside the pages emptied by a compaction for reuse.
+void
+page_release_evacuated(void);
+
+/// Clear the mark bits of every page.
+void
+page_clear_marks(void);
+
+/// Release every page, along with any slots that are still in use.
+void
+free_pages(void);
@@ -0,0 +1,171 @@
+#include "page.h"
+#include "unity.h"
+#include <stdlib.h>
+#include <string.h>
+
+void
+setUp() {}
+
+void
+tearDown() {}
+
+void
+test_slot_sizes_round_up_to_class(void) {
+    TEST_ASSERT_EQUAL(16, page_slot_size(1));
+    TEST_ASSERT_EQUAL(16, page_slot_size(16));
+    TEST_ASSERT_EQUAL(48, page_slot_size(40));
+    TEST_ASSERT_EQUAL(512, page_slot_size(300));
+    TEST_ASSERT_EQUAL(16 * 1024, page_slot_size(9000));
+    TEST_ASSERT_EQUAL(PAGE_MAX_SLOT, page_slot_size(PAGE_MAX_SLOT - 1));
+    TEST_ASSERT_EQUAL(PAGE_MAX_SLOT + 16, page_slot_size(PAGE_MAX_SLOT + 1));
+}
+
+void
+test_mid_size_blocks_share_a_page(void) {
+    void* first = page_allocate(300);
+    void* second = page_allocate(300);
+    TEST_ASSERT_EQUAL_PTR(page_of(first), page_of(second));
+    TEST_ASSERT_NOT_EQUAL(PAGE_LARGE_CLASS, page_of(first)->size_class);
+    TEST_ASSERT_EQUAL(512, page_stride(page_of(first)));
+    TEST_ASSERT_NULL(page_large_objects());
+    page_free(first);
+    page_free(second);
+    free_pages();
+}
+
+void
+test_mid_size_blocks_are_not_limited_by_pages(void) {
+    // More blocks than there are pages in a 4 GiB heap cage.
+    int    count = 70000;
+    void** blocks = malloc(sizeof(void*) * count);
+    for (int i = 0; i < count; i++) {
+        blocks[i] = page_allocate(300);
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        page_free(blocks[i]);
+    }
+    free(blocks);
+    free_pages();
+}
+
+void
+test_freed_slot_is_reused(void) {
+    void* first = page_allocate(40);
+    page_free(first);
+    void* second = page_allocate(40);
+    TEST_ASSERT_EQUAL_PTR(first, second);
+    page_free(second);
+    free_pages();
+}
+
+void
+test_slots_are_found_by_page(void) {
+    void* small = page_allocate(16);
+    void* large = page_allocate(200);
+    TEST_ASSERT_NOT_EQUAL(page_of(small), page_of(large));
+    TEST_ASSERT_EQUAL(1, page_of(small)->live);
+    page_free(small);
+    page_free(large);
+    free_pages();
+}
+
+void
+test_large_block_gets_own_page(void) {
+    void* large = page_allocate(PAGE_MAX_SLOT * 4);
+    TEST_ASSERT_EQUAL(PAGE_LARGE_CLASS, page_of(large)->size_class);
+    page_free(large);
+    free_pages();
+}
+
+void
+test_large_page_header_is_slim(void) {
+    void* large = page_allocate(PAGE_MAX_SLOT * 4);
+    TEST_ASSERT_EQUAL(
+        PAGE_LARGE_HEADER_SIZE, (char*)large - (char*)page_of(large));
+    TEST_ASSERT_TRUE(page_is_allocated(large));
+    TEST_ASSERT_TRUE(page_set_marked(large));
+    page_clear_marks();
+    TEST_ASSERT_FALSE(page_is_marked(large));
+    page_free(large);
+    free_pages();
+}
+
+void
+test_large_pages_are_kept_apart(void) {
+    void* large = page_allocate(PAGE_SIZE * 2);
+    TEST_ASSERT_NULL(page_heap());
+    TEST_ASSERT_EQUAL_PTR(page_of(large), page_large_objects());
+    page_free(large);
+    TEST_ASSERT_NULL(page_large_objects());
+}
+
+void
+test_scavenged_pages_are_reused(void) {
+    // Fill three pages of the smallest class, then empty them all.
+    int    count = (PAGE_SIZE - PAGE_HEADER_SIZE) / PAGE_SLOT_ALIGN * 3;
+    void** slots = malloc(sizeof(void*) * count);
+    for (int i = 0; i < count; i++) {
+        slots[i] = page_allocate(PAGE_SLOT_ALIGN);
+    }
+    Page* first = page_of(slots[0]);
+    for (int i = 0; i < count; i++) {
+        page_free(slots[i]);
+    }
+
+    // One empty page stays in its class and the other two are set aside.
+    page_release_empty();
+    size_t before = page_scavenged_bytes();
+    TEST_ASSERT_EQUAL(PAGE_SIZE, page_scavenge(PAGE_SIZE));
+    TEST_ASSERT_EQUAL(0, page_scavenge(PAGE_SIZE));
+    TEST_ASSERT_EQUAL(PAGE_SIZE, page_scavenge(0));
+    TEST_ASSERT_EQUAL(before + 2 * PAGE_SIZE, page_scavenged_bytes());
+
+    // A new class takes a page that was handed back, with a fresh header.
+    void* slot = page_allocate(PAGE_SLOT_ALIGN * 2);
+    memset(slot, 0xff, PAGE_SLOT_ALIGN * 2);
+    TEST_ASSERT_NOT_EQUAL(first, page_of(slot));
+    TEST_ASSERT_EQUAL(1, page_of(slot)->size_class);
+    TEST_ASSERT_EQUAL(1, page_of(slot)->live);
+    page_free(slot);
+    free(slots);
+    free_pages();
+}
+
+void
+test_mark_bits_are_per_slot(void) {
+    void* first = page_allocate(16);
+    void* second = page_allocate(16);
+    TEST_ASSERT_TRUE(page_set_marked(first));
+    TEST_ASSERT_FALSE(page_set_marked(first));
+    TEST_ASSERT_FALSE(page_is_marked(second));
+    page_clear_marks();
+    TEST_ASSERT_FALSE(page_is_marked(first));
+    free_pages();
+}
+
+void
+test_freed_slot_is_not_allocated(void) {
+    void* slot = page_allocate(32);
+    TEST_ASSERT_TRUE(page_is_allocated(slot));
+    page_free(slot);
+    TEST_ASSERT_FALSE(page_is_allocated(slot));
+    free_pages();
+}
+
+int
+main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_slot_sizes_round_up_to_class);
+    RUN_TEST(test_mid_size_blocks_share_a_page);
+    RUN_TEST(test_mid_size_blocks_are_not_limited_by_pages);
+    RUN_TEST(test_freed_slot_is_reused);
+    RUN_TEST(test_slots_are_found_by_page);
+    RUN_TEST(test_large_block_gets_own_page);
+    RUN_TEST(test_large_page_header_is_slim);
+    RUN_TEST(test_large_pages_are_kept_apart);
+    RUN_TEST(test_scavenged_pages_are_reused);
+    RUN_TEST(test_mark_bits_are_per_slot);
+    RUN_TEST(test_freed_slot_is_not_allocated);
+    return UNITY_END();
+}
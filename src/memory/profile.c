@@ -0,0 +1,285 @@
+// File:    profile.c
+// Purpose: Implement profile.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "profile.h"
+#include "memory.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The longest frame label written to a folded stack.
+#define PROFILE_MAX_LABEL 128
+
+/// The allocations charged to one call stack.
+typedef struct {
+    char*    stack;     // The folded call stack, outermost frame first.
+    uint32_t hash;      // The hash of the stack.
+    size_t   allocated; // The sampled bytes allocated.
+    size_t   survived;  // The sampled bytes that outlived a collection.
+    size_t   live;      // The sampled bytes not found unreachable yet.
+} ProfileSite;
+
+/// A sampled object that is followed through the collections.
+typedef struct {
+    Obj*   object;   // The object.
+    int    site;     // The index of the site that allocated it.
+    size_t weight;   // The bytes the sample stands for.
+    bool   survived; // Set once the object outlives a collection.
+} ProfileObject;
+
+/// The figure of a site that a profile file holds.
+typedef enum {
+    PROFILE_ALLOCATED, // The bytes allocated.
+    PROFILE_SURVIVED,  // The bytes that outlived a collection.
+    PROFILE_LIVE,      // The bytes not found unreachable yet.
+} ProfileMetric;
+
+int64_t profile_bytes_left = INT64_MAX;
+
+static size_t sample_interval = 0;
+
+static ProfileSite* sites = NULL;
+static int          site_count = 0;
+static int          site_capacity = 0;
+
+// An open addressing table from stack hashes to sites. Each entry holds
+// the index of a site plus one, so zero marks an empty entry.
+static int* site_table = NULL;
+static int  table_capacity = 0;
+
+static ProfileObject* objects = NULL;
+static int            object_count = 0;
+static int            object_capacity = 0;
+
+// The folded stack of the sample being taken.
+static char*  stack_buffer = NULL;
+static size_t stack_length = 0;
+static size_t stack_capacity = 0;
+
+static void*
+grow(void* pointer, int* capacity, size_t element_size) {
+    *capacity = *capacity < 8 ? 8 : *capacity * 2;
+    pointer = realloc(pointer, element_size * (size_t)*capacity);
+    if (pointer == NULL)
+        exit(1);
+    return pointer;
+}
+
+static void
+append_frame(const char* label) {
+    size_t length = strlen(label);
+    size_t needed = stack_length + length + 2;
+    if (needed > stack_capacity) {
+        stack_capacity = needed * 2;
+        stack_buffer = (char*)realloc(stack_buffer, stack_capacity);
+        if (stack_buffer == NULL)
+            exit(1);
+    }
+
+    if (stack_length > 0) {
+        stack_buffer[stack_length++] = ';';
+    }
+    memcpy(stack_buffer + stack_length, label, length + 1);
+    stack_length += length;
+}
+
+/// Fold the call stack of the script into stack_buffer. Each frame is the
+/// name of its function and the line it is at, such as "main:12".
+static void
+fold_stack() {
+    stack_length = 0;
+    if (vm.frame_count == 0) {
+        // Only the compiler allocates while no script runs.
+        append_frame("compiler");
+        return;
+    }
+
+    char label[PROFILE_MAX_LABEL];
+    for (int i = 0; i < vm.frame_count; i++) {
+        CallFrame*   frame = &vm.frames[i];
+        ObjFunction* function = DEREF(ObjFunction, frame->closure->function);
+        ObjString*   name = DEREF(ObjString, function->name);
+        size_t       instruction = frame->ip - function->bytecode.code - 1;
+        snprintf(
+            label,
+            sizeof(label),
+            "%s:%d",
+            name == NULL ? "script" : name->chars,
+            function->bytecode.lines[instruction]);
+        append_frame(label);
+    }
+}
+
+static uint32_t
+hash_stack(const char* stack, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)stack[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static void
+grow_site_table() {
+    free(site_table);
+    table_capacity = table_capacity < 16 ? 16 : table_capacity * 2;
+    site_table = (int*)calloc((size_t)table_capacity, sizeof(int));
+    if (site_table == NULL)
+        exit(1);
+
+    for (int i = 0; i < site_count; i++) {
+        uint32_t slot = sites[i].hash & (uint32_t)(table_capacity - 1);
+        while (site_table[slot] != 0) {
+            slot = (slot + 1) & (uint32_t)(table_capacity - 1);
+        }
+        site_table[slot] = i + 1;
+    }
+}
+
+/// Find the site for the stack in stack_buffer, adding it when it is new.
+///
+/// Returns:
+/// - int: The index of the site.
+static int
+find_site() {
+    if ((site_count + 1) * 2 > table_capacity) {
+        grow_site_table();
+    }
+
+    uint32_t hash = hash_stack(stack_buffer, stack_length);
+    uint32_t slot = hash & (uint32_t)(table_capacity - 1);
+    while (site_table[slot] != 0) {
+        ProfileSite* site = &sites[site_table[slot] - 1];
+        if (site->hash == hash && strcmp(site->stack, stack_buffer) == 0)
+            return site_table[slot] - 1;
+        slot = (slot + 1) & (uint32_t)(table_capacity - 1);
+    }
+
+    if (site_count == site_capacity) {
+        sites =
+            (ProfileSite*)grow(sites, &site_capacity, sizeof(ProfileSite));
+    }
+
+    ProfileSite* site = &sites[site_count];
+    site->stack = (char*)malloc(stack_length + 1);
+    if (site->stack == NULL)
+        exit(1);
+    memcpy(site->stack, stack_buffer, stack_length + 1);
+    site->hash = hash;
+    site->allocated = 0;
+    site->survived = 0;
+    site->live = 0;
+
+    site_table[slot] = site_count + 1;
+    return site_count++;
+}
+
+void
+profile_start(size_t interval) {
+    sample_interval = interval == 0 ? PROFILE_DEFAULT_INTERVAL : interval;
+    profile_bytes_left = (int64_t)sample_interval;
+}
+
+void
+profile_sample(Obj* object) {
+    // An allocation bigger than the interval stands for every sample that
+    // falls inside of it.
+    int64_t samples = 1 + -profile_bytes_left / (int64_t)sample_interval;
+    size_t  weight = (size_t)samples * sample_interval;
+    profile_bytes_left += samples * (int64_t)sample_interval;
+
+    fold_stack();
+    int index = find_site();
+    sites[index].allocated += weight;
+    if (object == NULL)
+        return;
+
+    sites[index].live += weight;
+    if (object_count == object_capacity) {
+        objects = (ProfileObject*)grow(
+            objects, &object_capacity, sizeof(ProfileObject));
+    }
+    objects[object_count++] = (ProfileObject){object, index, weight, false};
+}
+
+void
+profile_sweep(void) {
+    int i = 0;
+    while (i < object_count) {
+        ProfileObject* sampled = &objects[i];
+        ProfileSite*   site = &sites[sampled->site];
+        if (!is_object_marked(sampled->object)) {
+            site->live -= sampled->weight;
+            *sampled = objects[--object_count];
+            continue;
+        }
+
+        if (!sampled->survived) {
+            sampled->survived = true;
+            site->survived += sampled->weight;
+        }
+        i++;
+    }
+}
+
+void
+profile_forward(void) {
+    for (int i = 0; i < object_count; i++) {
+        objects[i].object = forward_object(objects[i].object);
+    }
+}
+
+void
+profile_forget(void) {
+    for (int i = 0; i < object_count; i++) {
+        sites[objects[i].site].live -= objects[i].weight;
+    }
+    object_count = 0;
+}
+
+static size_t
+site_bytes(const ProfileSite* site, ProfileMetric metric) {
+    switch (metric) {
+        case PROFILE_ALLOCATED:
+            return site->allocated;
+        case PROFILE_SURVIVED:
+            return site->survived;
+        case PROFILE_LIVE:
+            return site->live;
+    }
+    return 0;
+}
+
+static bool
+write_folded(const char* path, const char* suffix, ProfileMetric metric) {
+    size_t length = strlen(path) + strlen(suffix) + 1;
+    char*  name = (char*)malloc(length);
+    if (name == NULL)
+        return false;
+    snprintf(name, length, "%s%s", path, suffix);
+
+    FILE* file = fopen(name, "w");
+    free(name);
+    if (file == NULL)
+        return false;
+
+    for (int i = 0; i < site_count; i++) {
+        size_t bytes = site_bytes(&sites[i], metric);
+        if (bytes > 0) {
+            fprintf(file, "%s %zu\n", sites[i].stack, bytes);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+bool
+profile_write(const char* path) {
+    bool written = write_folded(path, "", PROFILE_ALLOCATED);
+    written = write_folded(path, ".survived", PROFILE_SURVIVED) && written;
+    written = write_folded(path, ".live", PROFILE_LIVE) && written;
+    return written;
+}
@@ -0,0 +1,78 @@
+// File:    profile.h
+// Purpose: Definitions for the sampling allocation profiler, which finds
+//          the lines of a script that allocate the most memory.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include "object.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The default number of bytes allocated between two samples.
+#define PROFILE_DEFAULT_INTERVAL (64 * 1024)
+
+// The bytes the program may allocate before the next sample is taken. It
+// only reaches zero while the profiler is running.
+extern int64_t profile_bytes_left;
+
+/// Count an allocation towards the next sample.
+///
+/// Params:
+/// - size: The size in bytes of the allocation.
+///
+/// Returns:
+/// - bool: True when the allocation should be passed to profile_sample.
+static inline bool
+profile_is_due(size_t size) {
+    profile_bytes_left -= (int64_t)size;
+    return profile_bytes_left <= 0;
+}
+
+/// Start sampling allocations. Each sample stands for the interval of
+/// bytes allocated before it and is charged to the call stack of the
+/// script at that moment.
+///
+/// Params:
+/// - interval: The number of bytes allocated between two samples.
+void
+profile_start(size_t interval);
+
+/// Take a sample for an allocation that profile_is_due picked.
+///
+/// Params:
+/// - object: The object that was allocated, or NULL for a plain block. An
+///   object is followed through the collections it survives.
+void
+profile_sample(Obj* object);
+
+/// Drop the sampled objects that a collection found unreachable, and count
+/// the rest as survivors. Runs once marking is complete, before the sweep.
+void
+profile_sweep(void);
+
+/// Update the sampled objects that a compaction moved.
+void
+profile_forward(void);
+
+/// Drop every sampled object, as the heap is about to be freed whole. The
+/// bytes they stand for no longer count as live.
+void
+profile_forget(void);
+
+/// Write the profile as folded stacks, one line per call stack followed by
+/// its bytes, which flame graph tools and pprof converters read. Three
+/// files are written: path holds the bytes allocated, path.survived the
+/// bytes that outlived at least one collection, and path.live the bytes no
+/// collection has found unreachable yet. Plain blocks, such as the arrays
+/// of a function, only count towards the first.
+///
+/// Params:
+/// - path: The file to write.
+///
+/// Returns:
+/// - bool: True when every file was written.
+bool
+profile_write(const char* path);
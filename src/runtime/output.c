@@ -0,0 +1,186 @@
+// File:    output.c
+// Purpose: Implement output.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "output.h"
+#include "vm.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <limits.h>
+#define STDOUT_FILENO 1
+#define isatty        _isatty
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Text that output_format writes in one go without allocating.
+#define FORMAT_BUFFER_SIZE 256
+
+#ifdef _WIN32
+
+static void
+write_all(const char* chars, size_t length) {
+    while (length > 0) {
+        unsigned chunk = length > INT_MAX ? INT_MAX : (unsigned)length;
+        int      written = _write(STDOUT_FILENO, chars, chunk);
+        if (written <= 0)
+            return;
+        chars += written;
+        length -= (size_t)written;
+    }
+}
+
+static void
+write_out(
+    const char* head, size_t head_size, const char* tail, size_t tail_size) {
+    write_all(head, head_size);
+    write_all(tail, tail_size);
+}
+
+#else
+
+/// Write two runs of bytes to standard out with as few system calls as the
+/// kernel allows, picking up where a short write left off.
+static void
+write_out(
+    const char* head, size_t head_size, const char* tail, size_t tail_size) {
+    struct iovec pieces[2] = {
+        {(void*)head, head_size},
+        {(void*)tail, tail_size},
+    };
+    struct iovec* piece = pieces;
+    int           count = 2;
+
+    while (count > 0) {
+        if (piece->iov_len == 0) {
+            piece++;
+            count--;
+            continue;
+        }
+
+        ssize_t written = writev(STDOUT_FILENO, piece, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            // Nobody is reading any more, so the bytes are dropped.
+            return;
+        }
+
+        size_t done = (size_t)written;
+        while (count > 0 && done >= piece->iov_len) {
+            done -= piece->iov_len;
+            piece++;
+            count--;
+        }
+        if (count > 0) {
+            piece->iov_base = (char*)piece->iov_base + done;
+            piece->iov_len -= done;
+        }
+    }
+}
+
+#endif
+
+void
+init_output(size_t capacity) {
+    static bool registered = false;
+    if (!registered) {
+        // Whatever is buffered when the program exits is still written.
+        atexit(output_flush);
+        registered = true;
+    }
+
+    free_output();
+    vm.output.line_flush = isatty(STDOUT_FILENO);
+    if (capacity == 0)
+        return;
+
+    vm.output.chars = (char*)malloc(capacity);
+    if (vm.output.chars != NULL) {
+        vm.output.capacity = capacity;
+    }
+}
+
+void
+free_output(void) {
+    output_flush();
+    free(vm.output.chars);
+    vm.output.chars = NULL;
+    vm.output.count = 0;
+    vm.output.capacity = 0;
+}
+
+void
+output_write(const char* chars, size_t length) {
+    Output* output = &vm.output;
+    if (length == 0)
+        return;
+
+    if (length > output->capacity - output->count) {
+        if (length >= output->capacity / 2) {
+            // Copying a large payload only to write it out again costs more
+            // than a second piece in the same writev.
+            fflush(stdout);
+            write_out(output->chars, output->count, chars, length);
+            output->count = 0;
+            return;
+        }
+        output_flush();
+    }
+
+    memcpy(output->chars + output->count, chars, length);
+    output->count += length;
+
+    if (output->line_flush && memchr(chars, '\n', length) != NULL) {
+        output_flush();
+    }
+}
+
+void
+output_string(const char* string) {
+    output_write(string, strlen(string));
+}
+
+void
+output_format(const char* format, ...) {
+    char    text[FORMAT_BUFFER_SIZE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+
+    if ((size_t)length < sizeof(text)) {
+        output_write(text, (size_t)length);
+        return;
+    }
+
+    char* large = (char*)malloc((size_t)length + 1);
+    if (large == NULL)
+        return;
+    va_start(args, format);
+    vsnprintf(large, (size_t)length + 1, format, args);
+    va_end(args);
+    output_write(large, (size_t)length);
+    free(large);
+}
+
+void
+output_flush(void) {
+    // Anything written with stdio, such as the prompt of the repl, goes
+    // first.
+    fflush(stdout);
+    if (vm.output.count > 0) {
+        write_out(vm.output.chars, vm.output.count, NULL, 0);
+        vm.output.count = 0;
+    }
+}
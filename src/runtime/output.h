@@ -0,0 +1,61 @@
+// File:    output.h
+// Purpose: Definitions for the buffer that printed values go through on
+//          their way to standard out.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The size of the output buffer unless --output-buffer says otherwise.
+#define OUTPUT_DEFAULT_BUFFER_SIZE (64 * 1024)
+
+/// Bytes waiting to be written to standard out.
+typedef struct {
+    char*  chars;      // The buffered bytes.
+    size_t count;      // The number of bytes buffered.
+    size_t capacity;   // The size of the buffer, 0 when unbuffered.
+    bool   line_flush; // Flush at each newline, when out is a terminal.
+} Output;
+
+/// Set up the output buffer of the vm. Until this is called, or when it
+/// cannot allocate the buffer, output is written straight through.
+///
+/// Params:
+/// - capacity: The size of the buffer in bytes, 0 for no buffer.
+void
+init_output(size_t capacity);
+
+/// Flush the output buffer and free it.
+void
+free_output(void);
+
+/// Write bytes to standard out through the buffer. A payload too large to
+/// fit is written together with the buffered bytes in a single writev,
+/// without being copied.
+///
+/// Params:
+/// - chars: The bytes to write.
+/// - length: The number of bytes.
+void
+output_write(const char* chars, size_t length);
+
+/// Write a string to standard out through the buffer.
+///
+/// Params:
+/// - string: The string, ending with a null character.
+void
+output_string(const char* string);
+
+/// Write formatted text to standard out through the buffer, as printf.
+///
+/// Params:
+/// - format: The printf format.
+void
+output_format(const char* format, ...);
+
+/// Write everything in the buffer to standard out.
+void
+output_flush(void);
@@ -8,6 +8,7 @@
 #include "compiler.h"
 #include "debug.h"
 #include "hash_map.h"
+#include "heap_dump.h"
 #include "memory.h"
 #include "object.h"
 #include "value.h"
@@ -28,13 +29,10 @@ clock_native(int arg_count, Value* args) {
 
 static Value
 println_native(int arg_count, Value* args) {
-    if (arg_count == 0) {
-        printf("\n");
-        return NIL_VAL;
+    if (arg_count > 0) {
+        print_value(args[0]);
     }
-
-    print_value(args[0]);
-    printf("\n");
+    output_write("\n", 1);
     return NIL_VAL;
 }
 
@@ -47,6 +45,220 @@ print_native(int arg_count, Value* args) {
     return NIL_VAL;
 }
 
+static Value
+flush_native(int arg_count, Value* args) {
+    output_flush();
+    return NIL_VAL;
+}
+
+/// Set a number field on the instance at the top of the stack.
+///
+/// Params:
+/// - name: The name of the field.
+/// - number: The value of the field.
+static void
+set_stat(const char* name, double number) {
+    ObjInstance* stats = AS_INSTANCE(vm.stack_top[-1]);
+    push(OBJ_VAL(copy_string(name, (int)strlen(name))));
+    hashmap_set(
+        &stats->fields, AS_STRING(vm.stack_top[-1]), NUMBER_VAL(number));
+    pop();
+}
+
+static Value
+gc_stats_native(int arg_count, Value* args) {
+    // The census may finish a lazy sweep, so it runs before anything is
+    // allocated here.
+    HeapCensus census;
+    take_heap_census(&census);
+
+    push(OBJ_VAL(copy_string("GcStats", 7)));
+    ObjClass* klass = new_class(AS_STRING(vm.stack_top[-1]));
+    push(OBJ_VAL(klass));
+    push(OBJ_VAL(new_instance(klass)));
+
+    const GcStats* stats = &vm.gc_stats;
+    size_t         objects = 0;
+    for (int type = 0; type < OBJ_TYPE_COUNT; type++) {
+        objects += census.counts[type];
+    }
+    set_stat("bytes", (double)vm.bytes_allocated);
+    set_stat("objects", (double)objects);
+    set_stat("next_gc", (double)vm.next_gc);
+    set_stat("collections", (double)stats->collections);
+    set_stat("pauses", (double)stats->pauses);
+    set_stat("total_pause_us", (double)stats->total_pause_us);
+    set_stat("max_pause_us", (double)stats->max_pause_us);
+    set_stat("last_freed", (double)stats->last_freed);
+    set_stat("total_freed", (double)stats->total_freed);
+
+    char name[64];
+    for (int i = 0; i < GC_PAUSE_BUCKETS; i++) {
+        snprintf(name, sizeof(name), "pauses_%s", gc_pause_bucket_name(i));
+        set_stat(name, (double)stats->histogram[i]);
+    }
+    for (int type = 0; type < OBJ_TYPE_COUNT; type++) {
+        const char* type_name = object_type_name((ObjType)type);
+        snprintf(name, sizeof(name), "%s_count", type_name);
+        set_stat(name, (double)census.counts[type]);
+        snprintf(name, sizeof(name), "%s_bytes", type_name);
+        set_stat(name, (double)census.bytes[type]);
+    }
+
+    Value result = pop();
+    pop();
+    pop();
+    return result;
+}
+
+/// Replace a rope or a slice in a stack slot with its flat string, for the
+/// natives that need a string of its own, such as a key or a C string.
+///
+/// Params:
+/// - slot: The slot to flatten, which keeps the rope reachable meanwhile.
+static void
+flatten_slot(Value* slot) {
+    if (IS_ROPE(*slot)) {
+        *slot = OBJ_VAL(flatten_rope(AS_ROPE(*slot)));
+    } else if (IS_SLICE(*slot)) {
+        *slot = OBJ_VAL(flatten_slice(AS_SLICE(*slot)));
+    }
+}
+
+/// Replace a string in a stack slot with the interned string that has the
+/// same characters, so equal strings make the same key.
+///
+/// Params:
+/// - slot: The slot to intern, which keeps the string reachable meanwhile.
+static void
+intern_slot(Value* slot) {
+    flatten_slot(slot);
+    if (IS_STRING(*slot)) {
+        *slot = OBJ_VAL(intern_string(AS_STRING(*slot)));
+    }
+}
+
+static Value
+heap_dump_native(int arg_count, Value* args) {
+    if (arg_count >= 1) {
+        flatten_slot(&args[0]);
+    }
+    if (arg_count < 1 || !IS_STRING(args[0]))
+        return BOOL_VAL(false);
+    return BOOL_VAL(heap_dump(AS_CSTRING(args[0])));
+}
+
+/// Get the characters from index start up to index end of a string, as a
+/// slice that shares them when there are enough. The indices are clamped
+/// to the string.
+static Value
+substring_native(int arg_count, Value* args) {
+    if (arg_count >= 1 && IS_ROPE(args[0])) {
+        args[0] = OBJ_VAL(flatten_rope(AS_ROPE(args[0])));
+    }
+    if (arg_count < 3 || !IS_FLAT_STRING(args[0]) || !IS_NUMBER(args[1])
+        || !IS_NUMBER(args[2]))
+        return NIL_VAL;
+
+    Obj*   text = AS_OBJ(args[0]);
+    double length = flat_length(text);
+    double start = AS_NUMBER(args[1]);
+    double end = AS_NUMBER(args[2]);
+    if (!(start >= 0)) {
+        start = 0;
+    }
+    if (start > length) {
+        start = length;
+    }
+    if (!(end <= length)) {
+        end = length;
+    }
+    if (end < start) {
+        end = start;
+    }
+    return OBJ_VAL(new_slice(text, (int)start, (int)end - (int)start));
+}
+
+static Value
+weak_ref_native(int arg_count, Value* args) {
+    if (arg_count < 1)
+        return NIL_VAL;
+    return OBJ_VAL(new_weak_ref(args[0]));
+}
+
+/// Hand a weakly held value back to the program, which holds it strongly
+/// from then on.
+static Value
+strengthen(Value value) {
+    if (IS_OBJ(value)) {
+        shade_object(AS_OBJ(value));
+    }
+    return value;
+}
+
+static Value
+weak_deref_native(int arg_count, Value* args) {
+    if (arg_count < 1 || !IS_WEAK_REF(args[0]))
+        return NIL_VAL;
+    return strengthen(AS_WEAK_REF(args[0])->target);
+}
+
+static Value
+weak_map_native(int arg_count, Value* args) {
+    return OBJ_VAL(new_weak_map());
+}
+
+static Value
+weak_map_get_native(int arg_count, Value* args) {
+    if (arg_count >= 2) {
+        intern_slot(&args[1]);
+    }
+    if (arg_count < 2 || !IS_WEAK_MAP(args[0]) || !IS_OBJ(args[1]))
+        return NIL_VAL;
+
+    Value value;
+    if (!weak_table_get(&AS_WEAK_MAP(args[0])->table, AS_OBJ(args[1]), &value))
+        return NIL_VAL;
+    return strengthen(value);
+}
+
+static Value
+weak_map_set_native(int arg_count, Value* args) {
+    if (arg_count >= 2) {
+        intern_slot(&args[1]);
+    }
+
+    // Only objects can be collected, so only they can be keys.
+    if (arg_count < 3 || !IS_WEAK_MAP(args[0]) || !IS_OBJ(args[1]))
+        return BOOL_VAL(false);
+    weak_table_set(&AS_WEAK_MAP(args[0])->table, AS_OBJ(args[1]), args[2]);
+    return BOOL_VAL(true);
+}
+
+static Value
+weak_map_has_native(int arg_count, Value* args) {
+    if (arg_count >= 2) {
+        intern_slot(&args[1]);
+    }
+    if (arg_count < 2 || !IS_WEAK_MAP(args[0]) || !IS_OBJ(args[1]))
+        return BOOL_VAL(false);
+
+    Value value;
+    return BOOL_VAL(
+        weak_table_get(&AS_WEAK_MAP(args[0])->table, AS_OBJ(args[1]), &value));
+}
+
+static Value
+weak_map_delete_native(int arg_count, Value* args) {
+    if (arg_count >= 2) {
+        intern_slot(&args[1]);
+    }
+    if (arg_count < 2 || !IS_WEAK_MAP(args[0]) || !IS_OBJ(args[1]))
+        return BOOL_VAL(false);
+    return BOOL_VAL(
+        weak_table_delete(&AS_WEAK_MAP(args[0])->table, AS_OBJ(args[1])));
+}
+
 static void
 reset_stack() {
     vm.stack_top = vm.stack;
@@ -56,6 +268,9 @@ reset_stack() {
 
 static void
 runtime_error(const char* format, ...) {
+    // What the program printed before the error shows before it.
+    output_flush();
+
     va_list args;
     va_start(args, format);
     vfprintf(stderr, format, args);
@@ -64,20 +279,22 @@ runtime_error(const char* format, ...) {
 
     for (int i = vm.frame_count - 1; i >= 0; i--) {
         CallFrame*   frame = &vm.frames[i];
-        ObjFunction* function = frame->closure->function;
+        ObjFunction* function =
+            DEREF(ObjFunction, frame->closure->function);
         size_t       instruction = frame->ip - function->bytecode.code - 1;
         fprintf(stderr, "[line %d] in ", function->bytecode.lines[instruction]);
-        if (function->name == NULL) {
+        if (DEREF(ObjString, function->name) == NULL) {
             fprintf(stderr, "script\n");
         } else {
-            fprintf(stderr, "%s()\n", function->name->chars);
+            fprintf(
+                stderr, "%s()\n", DEREF(ObjString, function->name)->chars);
         }
     }
 
-    CallFrame* frame = &vm.frames[vm.frame_count - 1];
-    size_t     instruction =
-        frame->ip - frame->closure->function->bytecode.code - 1;
-    int line = frame->closure->function->bytecode.lines[instruction];
+    CallFrame*   frame = &vm.frames[vm.frame_count - 1];
+    ObjFunction* function = DEREF(ObjFunction, frame->closure->function);
+    size_t       instruction = frame->ip - function->bytecode.code - 1;
+    int          line = function->bytecode.lines[instruction];
     fprintf(stderr, "[line %d] in script\n", line);
     reset_stack();
 }
@@ -110,11 +327,10 @@ peek(int distance) {
 
 static bool
 call(ObjClosure* closure, int arg_count) {
-    if (arg_count != closure->function->arity) {
+    ObjFunction* function = DEREF(ObjFunction, closure->function);
+    if (arg_count != function->arity) {
         runtime_error(
-            "Expected %d arguments but got %d.",
-            closure->function->arity,
-            arg_count);
+            "Expected %d arguments but got %d.", function->arity, arg_count);
         return false;
     }
 
@@ -125,7 +341,7 @@ call(ObjClosure* closure, int arg_count) {
 
     CallFrame* frame = &vm.frames[vm.frame_count++];
     frame->closure = closure;
-    frame->ip = closure->function->bytecode.code;
+    frame->ip = function->bytecode.code;
     frame->slots = vm.stack_top - arg_count - 1;
     return true;
 }
@@ -161,7 +377,7 @@ call_value(Value callee, int arg_count) {
             case OBJ_BOUND_METHOD: {
                 ObjBoundMethod* bound = AS_BOUND_METHOD(callee);
                 vm.stack_top[-arg_count - 1] = bound->receiver;
-                return call(bound->method, arg_count);
+                return call(DEREF(ObjClosure, bound->method), arg_count);
             }
             default:
                 break; // Non-callable object type.
@@ -199,7 +415,8 @@ invoke(ObjString* name, int arg_count) {
         return call_value(value, arg_count);
     }
 
-    return invoke_from_class(instance->klass, name, arg_count);
+    return invoke_from_class(
+        DEREF(ObjClass, instance->klass), name, arg_count);
 }
 
 static bool
@@ -222,7 +439,7 @@ capture_upvalue(Value* local) {
     ObjUpvalue* upvalue = vm.open_upvalues;
     while (upvalue != NULL && upvalue->location > local) {
         prev_upvalue = upvalue;
-        upvalue = upvalue->next;
+        upvalue = DEREF(ObjUpvalue, upvalue->next);
     }
 
     if (upvalue != NULL && upvalue->location == local) {
@@ -230,12 +447,12 @@ capture_upvalue(Value* local) {
     }
 
     ObjUpvalue* created_upvalue = new_upvalue(local);
-    created_upvalue->next = upvalue;
+    created_upvalue->next = TO_REF(upvalue);
 
     if (prev_upvalue == NULL) {
         vm.open_upvalues = created_upvalue;
     } else {
-        prev_upvalue->next = created_upvalue;
+        prev_upvalue->next = TO_REF(created_upvalue);
     }
 
     return created_upvalue;
@@ -247,15 +464,30 @@ close_upvalues(Value* last) {
         ObjUpvalue* upvalue = vm.open_upvalues;
         upvalue->closed = *upvalue->location;
         upvalue->location = &upvalue->closed;
-        vm.open_upvalues = upvalue->next;
+        write_barrier((Obj*)upvalue, upvalue->closed);
+        vm.open_upvalues = DEREF(ObjUpvalue, upvalue->next);
+    }
+}
+
+/// Store a value in a hash map that belongs to a heap object, running the
+/// gc barriers for both the old and the new value.
+static void
+set_field(Obj* owner, HashMap* fields, ObjString* name, Value value) {
+    Value old_value;
+    if (vm.gc_phase == GC_CONCURRENT
+        && hashmap_get(fields, name, &old_value)) {
+        overwrite_barrier(old_value);
     }
+
+    hashmap_set(fields, name, value);
+    write_barrier(owner, value);
 }
 
 static void
 define_method(ObjString* name) {
     Value     method = peek(0);
     ObjClass* klass = AS_CLASS(peek(1));
-    hashmap_set(&klass->methods, name, method);
+    set_field((Obj*)klass, &klass->methods, name, method);
     pop();
 }
 
@@ -281,83 +513,73 @@ is_falsey(Value value) {
 //     push(OBJ_VAL(result));
 // }
 
+/// Prepare an operand of a string concatenation. A number is converted to
+/// its string, which replaces it in its stack slot so the gc can find it.
+///
+/// Params:
+/// - distance: How far down the stack the operand is.
 static void
-concatenate() {
-    Value b_val = peek(0);
-    Value a_val = peek(1);
-
-    // Convert numbers to strings if needed
-    if (IS_NUMBER(a_val) || IS_NUMBER(b_val)) {
-        ObjString* a_str = NULL;
-        ObjString* b_str = NULL;
-
-        // Convert first operand if it's a number
-        if (IS_NUMBER(a_val)) {
-            a_str = number_to_string(AS_NUMBER(a_val));
-        } else {
-            a_str = AS_STRING(a_val);
-        }
+stringify_operand(int distance) {
+    Value* slot = &vm.stack_top[-1 - distance];
+    if (IS_NUMBER(*slot)) {
+        *slot = OBJ_VAL(number_to_string(AS_NUMBER(*slot)));
+    }
+}
 
-        // Convert second operand if it's a number
-        if (IS_NUMBER(b_val)) {
-            b_str = number_to_string(AS_NUMBER(b_val));
-        } else {
-            b_str = AS_STRING(b_val);
-        }
+static void
+concatenate() {
+    stringify_operand(1);
+    stringify_operand(0);
 
-        // Concatenate the strings
-        int   length = a_str->length + b_str->length;
-        char* chars = ALLOCATE(char, length + 1);
-        memcpy(chars, a_str->chars, a_str->length);
-        memcpy(chars + a_str->length, b_str->chars, b_str->length);
-        chars[length] = '\0';
-
-        ObjString* result = take_string(chars, length);
-
-        pop(); // pop b
-        pop(); // pop a
-        push(OBJ_VAL(result));
-    } else if (IS_STRING(a_val) && IS_STRING(b_val)) {
-        // Original string concatenation logic
-        const ObjString* b = AS_STRING(peek(0));
-        ObjString*       a = AS_STRING(peek(1));
-
-        int   length = a->length + b->length;
-        char* chars = ALLOCATE(char, length + 1);
-        memcpy(chars, a->chars, a->length);
-        memcpy(chars + a->length, b->chars, b->length);
-        chars[length] = '\0';
-
-        ObjString* result = take_string(chars, length);
-        pop();
-        pop();
-        push(OBJ_VAL(result));
-    } else {
-        runtime_error("Operands must be two numbers or two strings.");
-    }
+    Obj* result = concatenate_strings(AS_OBJ(peek(1)), AS_OBJ(peek(0)));
+    pop();
+    pop();
+    push(OBJ_VAL(result));
 }
 
 void
 init_vm() {
     reset_stack();
-    vm.objects = NULL;
+    vm.unswept = NULL;
+    vm.compact_pending = false;
 
-    vm.gray_count = 0;
-    vm.gray_capacity = 0;
-    vm.gray_stack = NULL;
+    init_gray_stack(&vm.gray_stack);
+    init_gray_stack(&vm.satb_log);
+    vm.deferred_count = 0;
+    vm.deferred_capacity = 0;
+    vm.deferred_frees = NULL;
+    atomic_init(&vm.marker_done, false);
 
     vm.bytes_allocated = 0;
-    vm.next_gc = 1024 * 1024;
+    vm.next_gc = GC_DEFAULT_MIN_HEAP;
+    vm.gc_step_bytes = 0;
+    vm.gc_phase = GC_IDLE;
+    init_gc_config(&vm.gc_config);
+    init_gc_stats(&vm.gc_stats);
 
     init_hashmap(&vm.globals);
     init_hashmap(&vm.strings);
 
     vm.init_string = NULL;
+    vm.weak_refs = NULL;
+    vm.weak_maps = NULL;
+    vm.out_of_memory = NULL;
     vm.init_string = copy_string("init", 4);
 
     define_native("clock", clock_native);
     define_native("print", print_native);
     define_native("println", println_native);
+    define_native("flush", flush_native);
+    define_native("gc_stats", gc_stats_native);
+    define_native("heap_dump", heap_dump_native);
+    define_native("substring", substring_native);
+    define_native("WeakRef", weak_ref_native);
+    define_native("weak_deref", weak_deref_native);
+    define_native("WeakMap", weak_map_native);
+    define_native("weak_map_get", weak_map_get_native);
+    define_native("weak_map_set", weak_map_set_native);
+    define_native("weak_map_has", weak_map_has_native);
+    define_native("weak_map_delete", weak_map_delete_native);
 }
 
 void
@@ -365,6 +587,8 @@ free_vm() {
     free_hashmap(&vm.globals);
     free_hashmap(&vm.strings);
     vm.init_string = NULL;
+    vm.weak_refs = NULL;
+    vm.weak_maps = NULL;
     free_objects();
 }
 
@@ -374,7 +598,8 @@ run() {
 
 #define READ_WORD() (*frame->ip++)
 #define READ_CONSTANT()                                                        \
-    (frame->closure->function->bytecode.constants.values[READ_WORD()])
+    (DEREF(ObjFunction, frame->closure->function)                              \
+         ->bytecode.constants.values[READ_WORD()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
 #define BINARY_OP(value_type, op)                                              \
     do {                                                                       \
@@ -389,18 +614,28 @@ run() {
 
     for (;;) {
 #ifdef DEBUG_TRACE_EXECUTION
-        printf("          ");
+        output_string("          ");
         for (Value* slot = vm.stack; slot < vm.stack_top; slot++) {
-            printf("[ ");
+            output_string("[ ");
             print_value(*slot);
-            printf(" ]");
+            output_string(" ]");
         }
-        printf("\n");
+        output_write("\n", 1);
+        ObjFunction* function = DEREF(ObjFunction, frame->closure->function);
         disassemble_instruction(
-            &frame->closure->function->bytecode,
-            (int)(frame->ip - frame->closure->function->bytecode.code));
+            &function->bytecode,
+            (int)(frame->ip - function->bytecode.code));
 #endif
 
+        // The only pointer held across instructions is the frame, which
+        // lives in the VM, so objects may move here.
+        if (vm.compact_pending) {
+            compact_heap();
+        }
+        if (heap_dump_requested) {
+            heap_dump_signaled();
+        }
+
         uint16_t instruction;
         switch (instruction = READ_WORD()) {
             case OP_CONSTANT: {
@@ -457,15 +692,26 @@ run() {
             }
             case OP_GET_UPVALUE: {
                 uint16_t slot = READ_WORD();
-                push(*frame->closure->upvalues[slot]->location);
+                push(*DEREF(ObjUpvalue, frame->closure->upvalues[slot])
+                          ->location);
                 break;
             }
             case OP_SET_UPVALUE: {
-                uint16_t slot = READ_WORD();
-                *frame->closure->upvalues[slot]->location = peek(0);
+                uint16_t    slot = READ_WORD();
+                ObjUpvalue* upvalue =
+                    DEREF(ObjUpvalue, frame->closure->upvalues[slot]);
+                overwrite_barrier(*upvalue->location);
+                *upvalue->location = peek(0);
+                write_barrier((Obj*)upvalue, peek(0));
                 break;
             }
             case OP_EQUAL: {
+                if (IS_ROPE(peek(0)) || IS_ROPE(peek(1))) {
+                    // Strings are compared by their characters, which a
+                    // rope only has in one place once it is flattened.
+                    flatten_slot(&vm.stack_top[-1]);
+                    flatten_slot(&vm.stack_top[-2]);
+                }
                 Value b = pop();
                 Value a = pop();
                 push(BOOL_VAL(values_equal(a, b)));
@@ -478,11 +724,11 @@ run() {
                 BINARY_OP(BOOL_VAL, <);
                 break;
             case OP_ADD: {
-                if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+                if (IS_ANY_STRING(peek(0)) && IS_ANY_STRING(peek(1))) {
                     concatenate();
-                } else if (IS_NUMBER(peek(0)) && IS_STRING(peek(1))) {
+                } else if (IS_NUMBER(peek(0)) && IS_ANY_STRING(peek(1))) {
                     concatenate();
-                } else if (IS_STRING(peek(0)) && IS_NUMBER(peek(1))) {
+                } else if (IS_ANY_STRING(peek(0)) && IS_NUMBER(peek(1))) {
                     concatenate();
                 } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
                     double b = AS_NUMBER(pop());
@@ -517,7 +763,7 @@ run() {
             }
             case OP_PRINT: {
                 print_value(pop());
-                printf("\n");
+                output_write("\n", 1);
                 break;
             }
             case OP_JUMP: {
@@ -553,12 +799,15 @@ run() {
                 for (int i = 0; i < closure->upvalue_count; i++) {
                     uint16_t is_local = READ_WORD();
                     uint16_t index = READ_WORD();
+                    ObjUpvalue* upvalue;
                     if (is_local) {
-                        closure->upvalues[i] =
-                            capture_upvalue(frame->slots + index);
+                        upvalue = capture_upvalue(frame->slots + index);
                     } else {
-                        closure->upvalues[i] = frame->closure->upvalues[index];
+                        upvalue = DEREF(
+                            ObjUpvalue, frame->closure->upvalues[index]);
                     }
+                    closure->upvalues[i] = TO_REF(upvalue);
+                    write_barrier((Obj*)closure, OBJ_VAL(upvalue));
                 }
                 break;
             }
@@ -590,7 +839,7 @@ run() {
                     break;
                 }
 
-                if (!bind_method(instance->klass, name)) {
+                if (!bind_method(DEREF(ObjClass, instance->klass), name)) {
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 break;
@@ -601,7 +850,8 @@ run() {
                     return INTERPRET_RUNTIME_ERROR;
                 }
                 ObjInstance* instance = AS_INSTANCE(peek(1));
-                hashmap_set(&instance->fields, READ_STRING(), peek(0));
+                set_field(
+                    (Obj*)instance, &instance->fields, READ_STRING(), peek(0));
                 Value value = pop();
                 pop();
                 push(value);
@@ -630,6 +880,7 @@ run() {
                 ObjClass* subclass = AS_CLASS(peek(0));
                 hashmap_copy_all(
                     &AS_CLASS(superclass)->methods, &subclass->methods);
+                write_barrier((Obj*)subclass, superclass);
                 pop(); // remove subclass
                 break;
             }
@@ -675,9 +926,23 @@ run() {
 #undef BINARY_OP
 }
 
-InterpretResult
-interpret(const char* source) {
-    ObjFunction* function = compile(source);
+/// Drop the heap of a run in arena mode and start the next run with a
+/// fresh one. The settings and the statistics carry over.
+static void
+reset_heap() {
+    GcConfig config = vm.gc_config;
+    GcStats  stats = vm.gc_stats;
+
+    free_vm();
+    init_vm();
+    vm.gc_config = config;
+    vm.gc_stats = stats;
+    apply_gc_config();
+}
+
+static InterpretResult
+run_source(const char* source, ObjString* owner) {
+    ObjFunction* function = compile(source, owner);
     if (function == NULL)
         return INTERPRET_COMPILE_ERROR;
 
@@ -686,5 +951,39 @@ interpret(const char* source) {
     pop();
     push(OBJ_VAL(closure));
     call(closure, 0);
-    return run();
+
+    // An allocation that cannot be satisfied unwinds to here.
+    jmp_buf out_of_memory;
+    vm.out_of_memory = &out_of_memory;
+    InterpretResult result =
+        setjmp(out_of_memory) == 0 ? run() : INTERPRET_RUNTIME_ERROR;
+    vm.out_of_memory = NULL;
+    return result;
+}
+
+InterpretResult
+interpret(const char* source) {
+    InterpretResult result = run_source(source, NULL);
+    if (vm.gc_config.arena) {
+        reset_heap();
+    }
+    return result;
+}
+
+InterpretResult
+interpret_string(ObjString* source) {
+    InterpretResult result = run_source(source->chars, source);
+    if (vm.gc_config.arena) {
+        reset_heap();
+    }
+    return result;
+}
+
+void
+raise_out_of_memory(void) {
+    if (vm.out_of_memory == NULL)
+        return;
+
+    runtime_error("Out of memory.");
+    longjmp(*vm.out_of_memory, 1);
 }
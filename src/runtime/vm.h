@@ -6,8 +6,13 @@
 #pragma once
 
 #include "hash_map.h"
+#include "memory.h"
 #include "object.h"
+#include "output.h"
+#include <setjmp.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <threads.h>
 
 #define FRAMES_MAX 1000
 #define STACK_MAX (FRAMES_MAX * 1024)
@@ -28,20 +33,33 @@ typedef enum {
 
 /// The virtual machine executes the bytecode program.
 typedef struct {
-    CallFrame   frames[FRAMES_MAX]; // A list of call frames.
-    int         frame_count;        // The number of call frames used.
-    Value       stack[STACK_MAX];   // The virtual machine stack.
-    Value*      stack_top;          // The pointer to the top of the stack.
-    Obj*        objects;         // The list of allocated objects on the heap.
-    HashMap     strings;         // The collection of interned strings.
-    ObjUpvalue* open_upvalues;   // Upvalues that are still live in the stack.
-    HashMap     globals;         // The collection of global variables.
-    int         gray_count;      // The number of gray objects.
-    int         gray_capacity;   // The total amount of capacity.
-    Obj**       gray_stack;      // The gc worklist.
-    size_t      bytes_allocated; // Size of heap allocations by gc
-    size_t      next_gc;         // Threshold for next gc in bytes
-    ObjString*  init_string;     // An interned string for the init method name.
+    CallFrame     frames[FRAMES_MAX]; // A list of call frames.
+    int           frame_count;        // The number of call frames used.
+    Value         stack[STACK_MAX];   // The virtual machine stack.
+    Value*        stack_top;          // The pointer to the top of the stack.
+    Page*         unswept;            // The next page for the lazy sweep.
+    HashMap       strings;            // The collection of interned strings.
+    ObjUpvalue*   open_upvalues;      // Upvalues still live in the stack.
+    HashMap       globals;            // The collection of global variables.
+    GrayStack     gray_stack;         // The gc worklist.
+    GrayStack     satb_log;           // Objects overwritten while marking.
+    int           deferred_count;     // The number of deferred frees.
+    int           deferred_capacity;  // The total deferred capacity.
+    DeferredFree* deferred_frees;     // Memory to free once marking ends.
+    thrd_t        marker;             // The concurrent marking thread.
+    atomic_bool   marker_done;        // Set by the marker when it runs dry.
+    size_t        bytes_allocated;    // Size of heap allocations by gc
+    size_t        next_gc;            // Threshold for next gc in bytes
+    size_t        gc_step_bytes;      // Bytes allocated since the last slice.
+    GcPhase       gc_phase;           // The phase of the current gc cycle.
+    GcConfig      gc_config;          // Settings that control the gc.
+    GcStats       gc_stats;           // What the gc has done so far.
+    bool          compact_pending;    // Set when the heap should be compacted.
+    ObjString*    init_string;        // An interned string for the init method.
+    ObjWeakRef*   weak_refs;          // Every weak reference, held weakly.
+    ObjWeakMap*   weak_maps;          // Every weak map, held weakly.
+    jmp_buf*      out_of_memory;      // Where a failed allocation unwinds to.
+    Output        output;             // Text waiting for standard out.
 } VM;
 
 extern VM vm;
@@ -54,7 +72,8 @@ init_vm();
 void
 free_vm();
 
-/// Interpret the bytecode.
+/// Interpret the bytecode. In arena mode the whole heap, globals included,
+/// is dropped once the source has run.
 ///
 /// Params:
 /// - source: The source code to interpret.
@@ -64,6 +83,27 @@ free_vm();
 InterpretResult
 interpret(const char* source);
 
+/// Interpret source code held in a heap string, as interpret does. Long
+/// string literals are slices of the string, which they keep alive, rather
+/// than copies.
+///
+/// Params:
+/// - source: The string that holds the source code.
+///
+/// Returns:
+/// - InterpretResult: The result of interpreting the bytecode.
+InterpretResult
+interpret_string(ObjString* source);
+
+/// Report that memory ran out as a runtime error, with a stack trace, and
+/// unwind to the interpreter. The program that was running stops.
+///
+/// Returns:
+/// - Only when no program is running, in which case there is nothing to
+///   unwind.
+void
+raise_out_of_memory(void);
+
 /// Push a new value to the top of the virtual machine stack.
 ///
 /// Params:
@@ -0,0 +1,100 @@
+// File:    hash.c
+// Purpose: Implement hash.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "hash.h"
+#include <stddef.h>
+#include <string.h>
+
+// Odd constants with an even mix of bits, taken from wyhash.
+#define HASH_P0 0xa0761d6478bd642full
+#define HASH_P1 0xe7037ed1a0b428dbull
+#define HASH_P2 0x8ebc6af09c88c6e3ull
+#define HASH_P3 0x589965cc75374cc3ull
+
+/// Multiply two words into 128 bits and fold the halves together.
+static inline uint64_t
+mix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    uint64_t a_high = a >> 32, a_low = (uint32_t)a;
+    uint64_t b_high = b >> 32, b_low = (uint32_t)b;
+    uint64_t high = a_high * b_high, low = a_low * b_low;
+    uint64_t cross1 = a_high * b_low, cross2 = a_low * b_high;
+    uint64_t middle = (low >> 32) + (uint32_t)cross1 + (uint32_t)cross2;
+    high += (cross1 >> 32) + (cross2 >> 32) + (middle >> 32);
+    low = (middle << 32) | (uint32_t)low;
+    return low ^ high;
+#endif
+}
+
+// Unaligned reads. The compiler turns the copies into single loads.
+
+static inline uint64_t
+read64(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline uint64_t
+read32(const uint8_t* p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+uint32_t
+hash_string(const char* key, int length) {
+    const uint8_t* p = (const uint8_t*)key;
+    size_t         size = (size_t)length;
+    uint64_t       seed = HASH_P0;
+    uint64_t       a;
+    uint64_t       b;
+
+    if (size <= 16) {
+        // Short keys, such as identifiers, are read as at most four
+        // overlapping 32-bit words, with no loop.
+        if (size >= 4) {
+            size_t middle = (size >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + middle);
+            b = (read32(p + size - 4) << 32) | read32(p + size - 4 - middle);
+        } else if (size > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8)
+                | p[size - 1];
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        size_t left = size;
+        if (left > 48) {
+            // Three independent lanes keep the multipliers busy.
+            uint64_t seed1 = seed;
+            uint64_t seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ HASH_P2, read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ HASH_P3, read64(p + 40) ^ seed2);
+                p += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (left > 16) {
+            seed = mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
+        // The last 16 bytes, which may overlap the ones already read.
+        a = read64(p + left - 16);
+        b = read64(p + left - 8);
+    }
+
+    uint64_t hash = mix(HASH_P1 ^ size, mix(a ^ HASH_P1, b ^ seed));
+    return (uint32_t)(hash ^ (hash >> 32));
+}
@@ -0,0 +1,22 @@
+// File:    hash.h
+// Purpose: Definitions for the hash function of strings.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include <stdint.h>
+
+/// Hash a run of bytes. The bytes are read eight at a time and mixed with
+/// 64-bit multiplies, in the manner of wyhash, and the result is folded to
+/// 32 bits. Every bit of the result depends on every byte, so the low bits
+/// that pick a slot in a hash table are as good as the high ones.
+///
+/// Params:
+/// - key: The start of the bytes.
+/// - length: The number of bytes.
+///
+/// Returns:
+/// - uint32_t: The hash.
+uint32_t
+hash_string(const char* key, int length);
@@ -0,0 +1,301 @@
+// File:    hash_bench.c
+// Purpose: Measure the quality and the speed of hash_string against the
+//          FNV-1a hash it replaced, over identifiers and long text.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+//
+// Built by configuring with -DSIGIL_BENCHMARKS=ON, then run as hash_bench.
+//
+// For each corpus and hash it reports:
+// - probes: The mean number of entries a lookup visits in a table that is
+//   75% full, probed linearly from hash & (capacity - 1) like find_entry.
+//   An ideal hash gives about 2.5.
+// - chi2: The chi-squared statistic of the keys spread by their low bits
+//   over up to one bucket per key, divided by the number of buckets. An
+//   ideal hash gives about 1.0.
+// - ns/key and MB/s: The time to hash every key of the corpus.
+
+#include "hash.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The number of keys in each identifier corpus.
+#define IDENTIFIER_COUNT 100000
+
+// The number of keys in the long text corpus, and their sizes.
+#define TEXT_COUNT    2000
+#define TEXT_MIN_SIZE 1024
+#define TEXT_MAX_SIZE 8192
+
+// How many bytes each speed measurement hashes at least.
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+/// A set of keys to hash.
+typedef struct {
+    const char* name;  // The name printed in the report.
+    char**      keys;  // The keys.
+    int*        sizes; // The size in bytes of each key.
+    int         count; // The number of keys.
+    size_t      bytes; // The total size of the keys.
+} Corpus;
+
+/// A hash function to measure.
+typedef struct {
+    const char* name;                       // The name in the report.
+    uint32_t (*function)(const char*, int); // The function.
+} Hasher;
+
+static uint32_t
+fnv1a(const char* key, int length) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static const Hasher hashers[] = {
+    {"fnv1a", fnv1a},
+    {"hash_string", hash_string},
+};
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ull;
+
+/// A xorshift generator, so every run builds the same corpora.
+static uint64_t
+next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static uint64_t
+now_ns(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void*
+checked_malloc(size_t size) {
+    void* pointer = malloc(size);
+    if (pointer == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(1);
+    }
+    return pointer;
+}
+
+static Corpus
+new_corpus(const char* name, int count) {
+    Corpus corpus;
+    corpus.name = name;
+    corpus.keys = (char**)checked_malloc(sizeof(char*) * (size_t)count);
+    corpus.sizes = (int*)checked_malloc(sizeof(int) * (size_t)count);
+    corpus.count = 0;
+    corpus.bytes = 0;
+    return corpus;
+}
+
+static void
+add_key(Corpus* corpus, const char* key, int size) {
+    char* copy = (char*)checked_malloc((size_t)size + 1);
+    memcpy(copy, key, (size_t)size);
+    copy[size] = '\0';
+    corpus->keys[corpus->count] = copy;
+    corpus->sizes[corpus->count++] = size;
+    corpus->bytes += (size_t)size;
+}
+
+static void
+free_corpus(Corpus* corpus) {
+    for (int i = 0; i < corpus->count; i++) {
+        free(corpus->keys[i]);
+    }
+    free(corpus->keys);
+    free(corpus->sizes);
+}
+
+/// Names that differ only in a counter, the hardest case for the low bits.
+static Corpus
+sequential_identifiers(void) {
+    static const char* formats[] = {"x%d", "field_%d", "getValue%d", "t%dx"};
+
+    Corpus corpus = new_corpus("sequential identifiers", IDENTIFIER_COUNT);
+    char   key[32];
+    for (int i = 0; i < IDENTIFIER_COUNT; i++) {
+        int size = snprintf(key, sizeof(key), formats[i % 4], i / 4);
+        add_key(&corpus, key, size);
+    }
+    return corpus;
+}
+
+/// Names of 4 to 16 letters, digits and underscores. They are long enough
+/// to be almost all different.
+static Corpus
+random_identifiers(void) {
+    static const char alphabet[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+
+    Corpus corpus = new_corpus("random identifiers", IDENTIFIER_COUNT);
+    char   key[16];
+    for (int i = 0; i < IDENTIFIER_COUNT; i++) {
+        int size = 4 + (int)(next_random() % (sizeof(key) - 3));
+        key[0] = alphabet[next_random() % 53];
+        for (int j = 1; j < size; j++) {
+            key[j] = alphabet[next_random() % (sizeof(alphabet) - 1)];
+        }
+        add_key(&corpus, key, size);
+    }
+    return corpus;
+}
+
+/// Lines of words, like the reports that scripts build by concatenation.
+static Corpus
+long_text(void) {
+    static const char* words[] = {
+        "the",   "request", "took",   "ms",      "status", "ok",
+        "error", "user",    "id",     "session", "line",   "of",
+        "total", "count",   "value",  "and",     "a",      "report",
+        "item",  "printed", "result", "with",    "from",   "to",
+    };
+    int word_count = (int)(sizeof(words) / sizeof(words[0]));
+
+    Corpus corpus = new_corpus("long text", TEXT_COUNT);
+    char*  text = (char*)checked_malloc(TEXT_MAX_SIZE + 32);
+    for (int i = 0; i < TEXT_COUNT; i++) {
+        int target = TEXT_MIN_SIZE
+                     + (int)(next_random()
+                             % (TEXT_MAX_SIZE - TEXT_MIN_SIZE + 1));
+        int size = 0;
+        while (size < target) {
+            if (next_random() % 8 == 0) {
+                size += snprintf(
+                    text + size,
+                    32,
+                    "%d ",
+                    (int)(next_random() % 100000));
+            } else {
+                const char* word = words[next_random() % word_count];
+                size += snprintf(text + size, 32, "%s ", word);
+            }
+        }
+        add_key(&corpus, text, target);
+    }
+    free(text);
+    return corpus;
+}
+
+/// The mean probe length of a successful lookup in a linear probing table
+/// filled to 75%, as in find_entry.
+static double
+mean_probes(const Corpus* corpus, const Hasher* hasher) {
+    uint32_t capacity = 4;
+    while (capacity * 2 * 3 / 4 <= (uint32_t)corpus->count) {
+        capacity <<= 1;
+    }
+    int keys = (int)(capacity * 3 / 4);
+
+    bool*  used = (bool*)calloc(capacity, sizeof(bool));
+    size_t probes = 0;
+    if (used == NULL)
+        exit(1);
+
+    for (int i = 0; i < keys; i++) {
+        uint32_t index =
+            hasher->function(corpus->keys[i], corpus->sizes[i])
+            & (capacity - 1);
+        probes++;
+        while (used[index]) {
+            index = (index + 1) & (capacity - 1);
+            probes++;
+        }
+        used[index] = true;
+    }
+
+    free(used);
+    return (double)probes / keys;
+}
+
+/// The chi-squared statistic of the low bits, divided by the number of
+/// buckets.
+static double
+chi_squared(const Corpus* corpus, const Hasher* hasher) {
+    uint32_t buckets = 1;
+    while (buckets * 2 <= (uint32_t)corpus->count) {
+        buckets <<= 1;
+    }
+
+    uint32_t* counts = (uint32_t*)calloc(buckets, sizeof(uint32_t));
+    if (counts == NULL)
+        exit(1);
+
+    for (int i = 0; i < corpus->count; i++) {
+        counts[hasher->function(corpus->keys[i], corpus->sizes[i])
+               & (buckets - 1)]++;
+    }
+
+    double expected = (double)corpus->count / buckets;
+    double sum = 0;
+    for (uint32_t i = 0; i < buckets; i++) {
+        double difference = counts[i] - expected;
+        sum += difference * difference / expected;
+    }
+
+    free(counts);
+    return sum / buckets;
+}
+
+static void
+measure(const Corpus* corpus, const Hasher* hasher) {
+    int rounds = (int)(BENCH_BYTES / (corpus->bytes + 1)) + 1;
+
+    volatile uint32_t sink = 0;
+    uint64_t          start = now_ns();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < corpus->count; i++) {
+            sink ^= hasher->function(corpus->keys[i], corpus->sizes[i]);
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    (void)sink;
+
+    double keys = (double)rounds * corpus->count;
+    double bytes = (double)rounds * (double)corpus->bytes;
+    printf(
+        "  %-12s probes %5.2f  chi2 %5.2f  %8.2f ns/key  %9.1f MB/s\n",
+        hasher->name,
+        mean_probes(corpus, hasher),
+        chi_squared(corpus, hasher),
+        elapsed / keys,
+        bytes / (elapsed / 1e9) / (1024 * 1024));
+}
+
+int
+main(void) {
+    Corpus corpora[] = {
+        sequential_identifiers(),
+        random_identifiers(),
+        long_text(),
+    };
+
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++) {
+        Corpus* corpus = &corpora[i];
+        printf(
+            "%s: %d keys, %.1f bytes each\n",
+            corpus->name,
+            corpus->count,
+            (double)corpus->bytes / corpus->count);
+        for (size_t j = 0; j < sizeof(hashers) / sizeof(hashers[0]); j++) {
+            measure(corpus, &hashers[j]);
+        }
+        free_corpus(corpus);
+    }
+    return 0;
+}
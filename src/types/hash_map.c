@@ -7,6 +7,7 @@
 #include "memory.h"
 #include "object.h"
 #include "value.h"
+#include <stdatomic.h>
 #include <string.h>
 
 #define TABLE_MAX_LOAD 0.75
@@ -16,6 +17,7 @@ init_hashmap(HashMap* hash_map) {
     hash_map->capacity = 0;
     hash_map->count = 0;
     hash_map->entries = NULL;
+    atomic_init(&hash_map->version, 0);
 }
 
 void
@@ -74,8 +76,18 @@ adjust_capacity(HashMap* hash_map, int capacity) {
     }
 
     FREE_ARRAY(Entry, hash_map->entries, hash_map->capacity);
+
+    // A concurrent marker must read the entries with their own capacity. It
+    // tries again when the version was odd or moved while it read them.
+    unsigned version =
+        atomic_load_explicit(&hash_map->version, memory_order_relaxed);
+    atomic_store_explicit(
+        &hash_map->version, version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
     hash_map->entries = new_entries;
     hash_map->capacity = capacity;
+    atomic_store_explicit(
+        &hash_map->version, version + 2, memory_order_release);
 }
 
 void
@@ -159,18 +171,43 @@ hashmap_find_string(
 
 void
 mark_hashmap(HashMap* hash_map) {
-    for (int i = 0; i < hash_map->capacity; i++) {
-        Entry* entry = &hash_map->entries[i];
+    // The entries that are read stay valid until marking ends, even when
+    // the program has replaced them since.
+    int      capacity;
+    Entry*   entries;
+    unsigned version;
+    do {
+        version =
+            atomic_load_explicit(&hash_map->version, memory_order_acquire);
+        entries = hash_map->entries;
+        capacity = hash_map->capacity;
+        atomic_thread_fence(memory_order_acquire);
+    } while ((version & 1) != 0
+             || atomic_load_explicit(
+                    &hash_map->version, memory_order_relaxed)
+                    != version);
+
+    for (int i = 0; i < capacity; i++) {
+        Entry* entry = &entries[i];
         mark_object((Obj*)entry->key);
         mark_value(entry->value);
     }
 }
 
+void
+forward_hashmap(HashMap* hash_map) {
+    for (int i = 0; i < hash_map->capacity; i++) {
+        Entry* entry = &hash_map->entries[i];
+        entry->key = (ObjString*)forward_object((Obj*)entry->key);
+        entry->value = forward_value(entry->value);
+    }
+}
+
 void
 hashmap_remove_white(HashMap* hash_map) {
     for (int i = 0; i < hash_map->capacity; i++) {
         Entry* entry = &hash_map->entries[i];
-        if (entry->key != NULL && !entry->key->obj.is_marked) {
+        if (entry->key != NULL && !is_object_marked((Obj*)entry->key)) {
             hashmap_delete(hash_map, entry->key);
         }
     }
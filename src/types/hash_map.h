@@ -7,6 +7,7 @@
 
 #include "common.h"
 #include "value.h"
+#include <stdatomic.h>
 
 typedef struct ObjString ObjString;
 
@@ -18,9 +19,10 @@ typedef struct {
 
 /// A hash map implementation to store keys and values.
 typedef struct {
-    int    count;    // The number of entries in the hash map.
-    int    capacity; // The total number of allowed entries in the hash map.
-    Entry* entries;  // The start of the entries.
+    int         count;    // The number of entries in the hash map.
+    int         capacity; // The total number of allowed entries.
+    Entry*      entries;  // The start of the entries.
+    atomic_uint version;  // Odd while entries and capacity are replaced.
 } HashMap;
 
 /// Initialize a new hash map.
@@ -103,6 +105,14 @@ hashmap_find_string(
 void
 mark_hashmap(HashMap* hash_map);
 
+/// Update the keys and values in the HashMap to the addresses of objects
+/// that a compaction moved.
+///
+/// Params:
+/// - hash_map: The hash map which contains references to update.
+void
+forward_hashmap(HashMap* hash_map);
+
 /// Remove all unreachable entries in the hash map.
 ///
 /// Params:
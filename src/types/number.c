@@ -0,0 +1,432 @@
+// File:    number.c
+// Purpose: Implement number.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+//
+// Digits come from Grisu2 (Loitsch, "Printing Floating-Point Numbers
+// Quickly and Accurately with Integers", PLDI 2010), laid out as in Milo
+// Yip's dtoa. Its output always reads back as the same double, and is the
+// shortest such output for almost every input. It needs only 64-bit integer
+// arithmetic and a table of 87 powers of ten, where snprintf works through
+// the digits one at a time.
+//
+// When every shorter output misses, Grisu2 may pick a 17-digit output that
+// reads back correctly but is not the closest one, such as
+// 0.30000000000000007 for 0.1 + 0.2. Those few are redone with snprintf,
+// which rounds exactly.
+
+#include "number.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DOUBLE_FRACTION_MASK 0x000fffffffffffffull
+#define DOUBLE_EXPONENT_MASK 0x7ff0000000000000ull
+#define DOUBLE_HIDDEN_BIT    0x0010000000000000ull
+#define DOUBLE_FRACTION_BITS 52
+#define DOUBLE_EXPONENT_BIAS (0x3ff + DOUBLE_FRACTION_BITS)
+
+// Integers below this are exact, so their digits are written directly.
+#define EXACT_INTEGER_LIMIT 9007199254740992.0
+
+// The most digits Grisu2 produces for a double.
+#define MAX_DIGITS 18
+
+// Enough digits for any double to read back the same.
+#define ROUND_TRIP_DIGITS 17
+
+/// A floating point number with a 64-bit significand: f * 2^e.
+typedef struct {
+    uint64_t f; // The significand.
+    int      e; // The binary exponent.
+} DiyFp;
+
+// The powers of ten from 10^-348 to 10^340 in steps of 8, each rounded to
+// a normalized 64-bit significand.
+static const DiyFp cached_powers[] = {
+    {0xfa8fd5a0081c0288ull, -1220}, {0xbaaee17fa23ebf76ull, -1193},
+    {0x8b16fb203055ac76ull, -1166}, {0xcf42894a5dce35eaull, -1140},
+    {0x9a6bb0aa55653b2dull, -1113}, {0xe61acf033d1a45dfull, -1087},
+    {0xab70fe17c79ac6caull, -1060}, {0xff77b1fcbebcdc4full, -1034},
+    {0xbe5691ef416bd60cull, -1007}, {0x8dd01fad907ffc3cull, -980},
+    {0xd3515c2831559a83ull, -954}, {0x9d71ac8fada6c9b5ull, -927},
+    {0xea9c227723ee8bcbull, -901}, {0xaecc49914078536dull, -874},
+    {0x823c12795db6ce57ull, -847}, {0xc21094364dfb5637ull, -821},
+    {0x9096ea6f3848984full, -794}, {0xd77485cb25823ac7ull, -768},
+    {0xa086cfcd97bf97f4ull, -741}, {0xef340a98172aace5ull, -715},
+    {0xb23867fb2a35b28eull, -688}, {0x84c8d4dfd2c63f3bull, -661},
+    {0xc5dd44271ad3cdbaull, -635}, {0x936b9fcebb25c996ull, -608},
+    {0xdbac6c247d62a584ull, -582}, {0xa3ab66580d5fdaf6ull, -555},
+    {0xf3e2f893dec3f126ull, -529}, {0xb5b5ada8aaff80b8ull, -502},
+    {0x87625f056c7c4a8bull, -475}, {0xc9bcff6034c13053ull, -449},
+    {0x964e858c91ba2655ull, -422}, {0xdff9772470297ebdull, -396},
+    {0xa6dfbd9fb8e5b88full, -369}, {0xf8a95fcf88747d94ull, -343},
+    {0xb94470938fa89bcfull, -316}, {0x8a08f0f8bf0f156bull, -289},
+    {0xcdb02555653131b6ull, -263}, {0x993fe2c6d07b7facull, -236},
+    {0xe45c10c42a2b3b06ull, -210}, {0xaa242499697392d3ull, -183},
+    {0xfd87b5f28300ca0eull, -157}, {0xbce5086492111aebull, -130},
+    {0x8cbccc096f5088ccull, -103}, {0xd1b71758e219652cull, -77},
+    {0x9c40000000000000ull, -50}, {0xe8d4a51000000000ull, -24},
+    {0xad78ebc5ac620000ull, 3}, {0x813f3978f8940984ull, 30},
+    {0xc097ce7bc90715b3ull, 56}, {0x8f7e32ce7bea5c70ull, 83},
+    {0xd5d238a4abe98068ull, 109}, {0x9f4f2726179a2245ull, 136},
+    {0xed63a231d4c4fb27ull, 162}, {0xb0de65388cc8ada8ull, 189},
+    {0x83c7088e1aab65dbull, 216}, {0xc45d1df942711d9aull, 242},
+    {0x924d692ca61be758ull, 269}, {0xda01ee641a708deaull, 295},
+    {0xa26da3999aef774aull, 322}, {0xf209787bb47d6b85ull, 348},
+    {0xb454e4a179dd1877ull, 375}, {0x865b86925b9bc5c2ull, 402},
+    {0xc83553c5c8965d3dull, 428}, {0x952ab45cfa97a0b3ull, 455},
+    {0xde469fbd99a05fe3ull, 481}, {0xa59bc234db398c25ull, 508},
+    {0xf6c69a72a3989f5cull, 534}, {0xb7dcbf5354e9beceull, 561},
+    {0x88fcf317f22241e2ull, 588}, {0xcc20ce9bd35c78a5ull, 614},
+    {0x98165af37b2153dfull, 641}, {0xe2a0b5dc971f303aull, 667},
+    {0xa8d9d1535ce3b396ull, 694}, {0xfb9b7cd9a4a7443cull, 720},
+    {0xbb764c4ca7a44410ull, 747}, {0x8bab8eefb6409c1aull, 774},
+    {0xd01fef10a657842cull, 800}, {0x9b10a4e5e9913129ull, 827},
+    {0xe7109bfba19c0c9dull, 853}, {0xac2820d9623bf429ull, 880},
+    {0x80444b5e7aa7cf85ull, 907}, {0xbf21e44003acdd2dull, 933},
+    {0x8e679c2f5e44ff8full, 960}, {0xd433179d9c8cb841ull, 986},
+    {0x9e19db92b4e31ba9ull, 1013}, {0xeb96bf6ebadf77d9ull, 1039},
+    {0xaf87023b9bf0ee6bull, 1066},};
+
+// The smallest decimal exponent in cached_powers, and the step between two.
+#define CACHED_POWER_MIN_EXPONENT (-348)
+#define CACHED_POWER_STEP         8
+
+static const uint32_t powers_of_ten[] = {
+    1,      10,      100,      1000,      10000,
+    100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+static DiyFp
+diy_from_double(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint64_t fraction = bits & DOUBLE_FRACTION_MASK;
+    int      biased =
+        (int)((bits & DOUBLE_EXPONENT_MASK) >> DOUBLE_FRACTION_BITS);
+    if (biased == 0) {
+        // A subnormal number.
+        return (DiyFp){fraction, 1 - DOUBLE_EXPONENT_BIAS};
+    }
+    return (DiyFp){fraction + DOUBLE_HIDDEN_BIT, biased - DOUBLE_EXPONENT_BIAS};
+}
+
+static DiyFp
+normalize(DiyFp x) {
+    while ((x.f & (1ull << 63)) == 0) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/// Get the numbers halfway to the neighbours of a double, normalized to
+/// the same exponent. Any number strictly between them reads back as it.
+static void
+boundaries(DiyFp v, DiyFp* minus, DiyFp* plus) {
+    DiyFp upper = {(v.f << 1) + 1, v.e - 1};
+    while ((upper.f & (DOUBLE_HIDDEN_BIT << 1)) == 0) {
+        upper.f <<= 1;
+        upper.e--;
+    }
+    upper.f <<= 64 - DOUBLE_FRACTION_BITS - 2;
+    upper.e -= 64 - DOUBLE_FRACTION_BITS - 2;
+
+    // The gap below a power of two is half the gap above it.
+    DiyFp lower = v.f == DOUBLE_HIDDEN_BIT ? (DiyFp){(v.f << 2) - 1, v.e - 2}
+                                           : (DiyFp){(v.f << 1) - 1, v.e - 1};
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    *minus = lower;
+    *plus = upper;
+}
+
+/// Multiply two numbers, keeping the rounded upper 64 bits of the product.
+static DiyFp
+multiply(DiyFp x, DiyFp y) {
+    uint64_t a = x.f >> 32, b = x.f & 0xffffffffu;
+    uint64_t c = y.f >> 32, d = y.f & 0xffffffffu;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t middle = (bd >> 32) + (ad & 0xffffffffu) + (bc & 0xffffffffu);
+    middle += 1u << 31;
+    uint64_t high = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+    return (DiyFp){high, x.e + y.e + 64};
+}
+
+/// Get a cached power of ten that brings a number with binary exponent e
+/// into the range where its digits can be generated with 64-bit integers.
+///
+/// Params:
+/// - e: The binary exponent of the number.
+/// - k: Set to the decimal exponent the number must be scaled back by.
+static DiyFp
+cached_power(int e, int* k) {
+    // 0.30102999566398114 is log10(2).
+    double estimate = (-61 - e) * 0.30102999566398114 + 347;
+    int    exponent = (int)estimate;
+    if (estimate - exponent > 0.0) {
+        exponent++;
+    }
+
+    int index = (exponent >> 3) + 1;
+    *k = -(CACHED_POWER_MIN_EXPONENT + index * CACHED_POWER_STEP);
+    return cached_powers[index];
+}
+
+static int
+count_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= powers_of_ten[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+/// Move the last digit down while that brings the digits closer to the
+/// exact value and keeps them inside the boundaries.
+static void
+round_weed(
+    char* buffer, int length, uint64_t delta, uint64_t rest,
+    uint64_t ten_kappa, uint64_t distance) {
+    while (rest < distance && delta - rest >= ten_kappa
+           && (rest + ten_kappa < distance
+               || distance - rest > rest + ten_kappa - distance)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+/// Generate the digits of the scaled upper boundary until they are closer
+/// to it than delta, which leaves them inside the boundaries.
+static int
+generate_digits(DiyFp w, DiyFp upper, uint64_t delta, char* buffer, int* k) {
+    DiyFp    one = {1ull << -upper.e, upper.e};
+    uint64_t distance = upper.f - w.f;
+    uint32_t whole = (uint32_t)(upper.f >> -one.e);
+    uint64_t part = upper.f & (one.f - 1);
+    int      kappa = count_digits(whole);
+    int      length = 0;
+
+    while (kappa > 0) {
+        uint32_t power = powers_of_ten[kappa - 1];
+        uint32_t digit = whole / power;
+        whole %= power;
+        if (digit != 0 || length != 0) {
+            buffer[length++] = (char)('0' + digit);
+        }
+        kappa--;
+
+        uint64_t rest = ((uint64_t)whole << -one.e) + part;
+        if (rest <= delta) {
+            *k += kappa;
+            round_weed(
+                buffer,
+                length,
+                delta,
+                rest,
+                (uint64_t)powers_of_ten[kappa] << -one.e,
+                distance);
+            return length;
+        }
+    }
+
+    for (;;) {
+        part *= 10;
+        delta *= 10;
+        char digit = (char)(part >> -one.e);
+        if (digit != 0 || length != 0) {
+            buffer[length++] = (char)('0' + digit);
+        }
+        part &= one.f - 1;
+        kappa--;
+
+        if (part < delta) {
+            *k += kappa;
+            int index = -kappa;
+            round_weed(
+                buffer,
+                length,
+                delta,
+                part,
+                one.f,
+                index < 10 ? distance * powers_of_ten[index] : 0);
+            return length;
+        }
+    }
+}
+
+/// Get the shortest digits of a positive finite number.
+///
+/// Params:
+/// - value: The number.
+/// - buffer: Where to write the digits, at least MAX_DIGITS characters.
+/// - k: Set to the decimal exponent of the last digit.
+///
+/// Returns:
+/// - int: The number of digits.
+static int
+grisu2(double value, char* buffer, int* k) {
+    DiyFp v = diy_from_double(value);
+    DiyFp minus;
+    DiyFp plus;
+    boundaries(v, &minus, &plus);
+
+    DiyFp power = cached_power(plus.e, k);
+    DiyFp w = multiply(normalize(v), power);
+    DiyFp upper = multiply(plus, power);
+    DiyFp lower = multiply(minus, power);
+
+    // The products may be off by one unit either way.
+    upper.f--;
+    lower.f++;
+    return generate_digits(w, upper, upper.f - lower.f, buffer, k);
+}
+
+/// Find the closest digits of a number with snprintf.
+///
+/// Params:
+/// - value: The number, finite and positive.
+/// - buffer: Where to write the digits, at least MAX_DIGITS long.
+/// - k: Set to the power of ten of the last digit.
+///
+/// Returns:
+/// - int: The number of digits.
+static int
+exact_digits(double value, char* buffer, int* k) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*e", ROUND_TRIP_DIGITS - 1, value);
+
+    // The text is one digit, a point, the other digits and the exponent.
+    int count = 0;
+    buffer[count++] = text[0];
+    memcpy(buffer + count, text + 2, ROUND_TRIP_DIGITS - 1);
+    count += ROUND_TRIP_DIGITS - 1;
+    while (count > 1 && buffer[count - 1] == '0') {
+        count--;
+    }
+
+    int exponent = atoi(text + ROUND_TRIP_DIGITS + 2);
+    *k = exponent + 1 - count;
+    return count;
+}
+
+/// Write digits followed by zeros, with a comma before each group of three
+/// counted from the right.
+static int
+write_grouped(char* out, const char* digits, int count, int zeros) {
+    int total = count + zeros;
+    int length = 0;
+    for (int i = 0; i < total; i++) {
+        if (i > 0 && (total - i) % 3 == 0) {
+            out[length++] = ',';
+        }
+        out[length++] = i < count ? digits[i] : '0';
+    }
+    return length;
+}
+
+static int
+write_exponent(char* out, int exponent) {
+    int length = 0;
+    out[length++] = 'e';
+    out[length++] = exponent < 0 ? '-' : '+';
+    if (exponent < 0) {
+        exponent = -exponent;
+    }
+    if (exponent >= 100) {
+        out[length++] = (char)('0' + exponent / 100);
+    }
+    if (exponent >= 10) {
+        out[length++] = (char)('0' + exponent / 10 % 10);
+    }
+    out[length++] = (char)('0' + exponent % 10);
+    return length;
+}
+
+/// Lay out digits whose decimal point comes after the first point digits.
+static int
+write_decimal(char* out, const char* digits, int count, int point) {
+    int length = 0;
+    if (count <= point && point <= 21) {
+        return write_grouped(out, digits, count, point - count);
+    }
+    if (0 < point && point <= 21) {
+        length = write_grouped(out, digits, point, 0);
+        out[length++] = '.';
+        memcpy(out + length, digits + point, count - point);
+        return length + count - point;
+    }
+    if (-6 < point && point <= 0) {
+        out[length++] = '0';
+        out[length++] = '.';
+        memset(out + length, '0', -point);
+        length += -point;
+        memcpy(out + length, digits, count);
+        return length + count;
+    }
+
+    out[length++] = digits[0];
+    if (count > 1) {
+        out[length++] = '.';
+        memcpy(out + length, digits + 1, count - 1);
+        length += count - 1;
+    }
+    return length + write_exponent(out + length, point - 1);
+}
+
+int
+format_number(double value, char* buffer) {
+    int length = 0;
+    if (isnan(value)) {
+        memcpy(buffer, "nan", 4);
+        return 3;
+    }
+    if (value < 0) {
+        buffer[length++] = '-';
+        value = -value;
+    }
+    if (isinf(value)) {
+        memcpy(buffer + length, "inf", 4);
+        return length + 3;
+    }
+    if (value == 0) {
+        // Negative zero is written as zero.
+        memcpy(buffer, "0", 2);
+        return 1;
+    }
+
+    char digits[MAX_DIGITS + 2];
+    int  count;
+    int  point;
+    if (value < EXACT_INTEGER_LIMIT && value == (double)(uint64_t)value) {
+        // Integers are common and need no search for their digits.
+        char     reversed[20];
+        uint64_t integer = (uint64_t)value;
+        count = 0;
+        while (integer > 0) {
+            reversed[count++] = (char)('0' + integer % 10);
+            integer /= 10;
+        }
+        for (int i = 0; i < count; i++) {
+            digits[i] = reversed[count - 1 - i];
+        }
+        point = count;
+    } else {
+        int k;
+        count = grisu2(value, digits, &k);
+        if (count >= ROUND_TRIP_DIGITS) {
+            count = exact_digits(value, digits, &k);
+        }
+        point = count + k;
+    }
+
+    length += write_decimal(buffer + length, digits, count, point);
+    buffer[length] = '\0';
+    return length;
+}
@@ -0,0 +1,24 @@
+// File:    number.h
+// Purpose: Definitions for writing numbers as text.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+// The most characters format_number writes, its terminator included.
+#define NUMBER_BUFFER_SIZE 48
+
+/// Write a number as the shortest decimal that reads back as the same
+/// number. Numbers from 1e-6 up to 1e21 are written out in full, with
+/// commas between groups of three digits in the whole part, such as
+/// "12,345.5". Others are written with an exponent, such as "1.5e+21".
+/// Infinities are "inf" and "-inf", and NaN is "nan".
+///
+/// Params:
+/// - value: The number to write.
+/// - buffer: Where to write it, at least NUMBER_BUFFER_SIZE characters.
+///
+/// Returns:
+/// - int: The number of characters written, not counting the terminator.
+int
+format_number(double value, char* buffer);
@@ -1,38 +1,51 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "bytecode.h"
 #include "common.h"
+#include "hash.h"
 #include "hash_map.h"
 #include "memory.h"
 #include "object.h"
+#include "output.h"
+#include "profile.h"
 #include "value.h"
 #include "vm.h"
 
 #define ALLOCATE_OBJ(type, objectType)                                         \
     (type*)allocate_object(sizeof(type), objectType)
 
-static uint32_t
-hash_string(const char* key, int length) {
-    uint32_t hash = 2166136261u;
-    for (int i = 0; i < length; i++) {
-        hash ^= (uint8_t)key[i];
-        hash *= 16777619;
-    }
-    return hash;
-}
+#define ALLOCATE_FLEX_OBJ(type, element_type, count, objectType)               \
+    (type*)allocate_object(                                                    \
+        sizeof(type) + sizeof(element_type) * (count), objectType)
 
 static Obj*
 allocate_object(size_t size, ObjType type) {
-    Obj* object = (Obj*)reallocate(NULL, 0, size);
+    Obj* object = (Obj*)allocate_cell(size);
     object->type = type;
-    object->is_marked = false;
 
-    object->next = vm.objects;
-    vm.objects = object;
+    // Objects created while a cycle is marking are traced before it ends,
+    // since the roots that held their references may already be scanned.
+    // A concurrent cycle only keeps them: everything they can reference was
+    // either reachable when it began or is new as well.
+    //
+    // Only unmarked objects are freed, so the slot starts out unmarked.
+    // While a lazy sweep is pending it is marked, since its page may not
+    // have been swept yet.
+    if (vm.gc_phase == GC_MARKING) {
+        set_object_marked(object);
+        gray_object(object);
+    } else if (vm.gc_phase == GC_CONCURRENT || vm.unswept != NULL) {
+        set_object_marked(object);
+    }
+
+    if (profile_is_due(size)) {
+        profile_sample(object);
+    }
 
 #ifdef DEBUG_LOG_GC
-    printf("%p allocate %zu for %d\n", (void*)object, size, type);
+    output_format("%p allocate %zu for %d\n", (void*)object, size, type);
 #endif
 
     return object;
@@ -40,14 +53,13 @@ allocate_object(size_t size, ObjType type) {
 
 ObjClosure*
 new_closure(ObjFunction* function) {
-    ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalue_count);
+    ObjClosure* closure = ALLOCATE_FLEX_OBJ(
+        ObjClosure, REF(ObjUpvalue), function->upvalue_count, OBJ_CLOSURE);
+    closure->function = TO_REF(function);
+    closure->upvalue_count = function->upvalue_count;
     for (int i = 0; i < function->upvalue_count; i++) {
-        upvalues[i] = NULL;
+        closure->upvalues[i] = TO_REF((ObjUpvalue*)NULL);
     }
-    ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
-    closure->function = function;
-    closure->upvalues = upvalues;
-    closure->upvalue_count = function->upvalue_count;
     return closure;
 }
 
@@ -56,7 +68,7 @@ new_function() {
     ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
     function->arity = 0;
     function->upvalue_count = 0;
-    function->name = NULL;
+    function->name = TO_REF((ObjString*)NULL);
     init_bytecode(&function->bytecode);
     return function;
 }
@@ -68,29 +80,46 @@ new_native(NativeFn function) {
     return native;
 }
 
-static ObjString*
-allocate_string(char* chars, int length, uint32_t hash) {
-    ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+ObjString*
+reserve_string(int length) {
+    ObjString* string =
+        ALLOCATE_FLEX_OBJ(ObjString, char, length + 1, OBJ_STRING);
     string->length = length;
-    string->chars = chars;
-    string->hash = hash;
+    string->hash = 0;
+    string->interned = false;
+    string->chars[length] = '\0';
+    return string;
+}
+
+static ObjString*
+add_string(ObjString* string) {
+    string->interned = true;
     push(OBJ_VAL(string));
     hashmap_set(&vm.strings, string, NIL_VAL);
     pop();
     return string;
 }
 
+
 ObjString*
 copy_string(const char* chars, int length) {
     uint32_t   hash = hash_string(chars, length);
     ObjString* interned = hashmap_find_string(&vm.strings, chars, length, hash);
     if (interned != NULL) {
+        shade_object((Obj*)interned);
         return interned;
     }
-    char* heapChars = ALLOCATE(char, length + 1);
-    memcpy(heapChars, chars, length);
-    heapChars[length] = '\0';
-    return allocate_string(heapChars, length, hash);
+    ObjString* string = reserve_string(length);
+    memcpy(string->chars, chars, length);
+    string->hash = hash;
+    return add_string(string);
+}
+
+ObjString*
+new_string(const char* chars, int length) {
+    ObjString* string = reserve_string(length);
+    memcpy(string->chars, chars, length);
+    return string;
 }
 
 ObjUpvalue*
@@ -98,56 +127,253 @@ new_upvalue(Value* slot) {
     ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
     upvalue->closed = NIL_VAL;
     upvalue->location = slot;
-    upvalue->next = NULL;
+    upvalue->next = TO_REF((ObjUpvalue*)NULL);
     return upvalue;
 }
 
 static void
 print_function(const ObjFunction* function) {
-    if (function->name == NULL) {
-        printf("<script>");
+    if (DEREF(ObjString, function->name) == NULL) {
+        output_string("<script>");
         return;
     }
-    printf("<fn %s>", function->name->chars);
+    output_format("<fn %s>", DEREF(ObjString, function->name)->chars);
 }
 
 ObjString*
-take_string(char* chars, int length) {
-    uint32_t   hash = hash_string(chars, length);
-    ObjString* interned = hashmap_find_string(&vm.strings, chars, length, hash);
+intern_string(ObjString* string) {
+    if (string->interned)
+        return string;
+
+    string->hash = hash_string(string->chars, string->length);
+    ObjString* interned = hashmap_find_string(
+        &vm.strings, string->chars, string->length, string->hash);
     if (interned != NULL) {
-        FREE_ARRAY(char, chars, length + 1);
+        // The string is dropped once nothing else refers to it.
+        shade_object((Obj*)interned);
         return interned;
     }
-    return allocate_string(chars, length, hash);
+    return add_string(string);
+}
+
+// The pieces of a rope that flatten_rope has yet to copy.
+static Obj** pending_pieces = NULL;
+static int   pending_capacity = 0;
+
+/// Get the flat string of a rope that was already flattened, or else the
+/// object itself.
+static Obj*
+skip_flattened(Obj* object) {
+    if (object->type == OBJ_ROPE) {
+        ObjRope* rope = (ObjRope*)object;
+        if (DEREF(Obj, rope->right) == NULL)
+            return DEREF(Obj, rope->left);
+    }
+    return object;
+}
+
+static int
+string_length(const Obj* object) {
+    return object->type == OBJ_ROPE ? ((const ObjRope*)object)->length
+                                    : flat_length(object);
+}
+
+static ObjRope*
+new_rope(Obj* left, Obj* right, int length) {
+    ObjRope* rope = ALLOCATE_OBJ(ObjRope, OBJ_ROPE);
+    rope->length = length;
+    rope->left = TO_REF(left);
+    rope->right = TO_REF(right);
+    return rope;
+}
+
+Obj*
+concatenate_strings(Obj* a, Obj* b) {
+    a = skip_flattened(a);
+    b = skip_flattened(b);
+
+    int a_length = string_length(a);
+    int b_length = string_length(b);
+    if (a_length == 0)
+        return b;
+    if (b_length == 0)
+        return a;
+
+    int length = a_length + b_length;
+    if (length >= ROPE_MIN_LENGTH)
+        return (Obj*)new_rope(a, b, length);
+
+    // Ropes are never this short, so both halves are flat.
+    ObjString* result = reserve_string(length);
+    memcpy(result->chars, flat_chars(a), a_length);
+    memcpy(result->chars + a_length, flat_chars(b), b_length);
+    return (Obj*)result;
+}
+
+static void
+push_piece(int count, Obj* piece) {
+    if (count == pending_capacity) {
+        int   capacity = GROW_CAPACITY(pending_capacity);
+        Obj** pieces =
+            (Obj**)realloc(pending_pieces, sizeof(Obj*) * (size_t)capacity);
+        if (pieces == NULL)
+            fail_allocation(0);
+        pending_pieces = pieces;
+        pending_capacity = capacity;
+    }
+    pending_pieces[count] = piece;
+}
+
+ObjString*
+flatten_rope(ObjRope* rope) {
+    if (DEREF(Obj, rope->right) == NULL)
+        return (ObjString*)DEREF(Obj, rope->left);
+
+    ObjString* string = reserve_string(rope->length);
+
+    // The pieces are copied from the last one back, so a rope built by
+    // appending in a loop, which leans left, needs only two pending pieces.
+    int end = rope->length;
+    int count = 0;
+    push_piece(count++, (Obj*)rope);
+    while (count > 0) {
+        Obj* piece = skip_flattened(pending_pieces[--count]);
+        if (piece->type == OBJ_ROPE) {
+            ObjRope* node = (ObjRope*)piece;
+            push_piece(count++, DEREF(Obj, node->left));
+            push_piece(count++, DEREF(Obj, node->right));
+        } else {
+            end -= flat_length(piece);
+            memcpy(string->chars + end, flat_chars(piece), flat_length(piece));
+        }
+    }
+
+    overwrite_barrier(OBJ_VAL(DEREF(Obj, rope->left)));
+    overwrite_barrier(OBJ_VAL(DEREF(Obj, rope->right)));
+    rope->left = TO_REF((Obj*)string);
+    rope->right = TO_REF((Obj*)NULL);
+    write_barrier((Obj*)rope, OBJ_VAL(string));
+    return string;
+}
+
+Obj*
+new_slice(Obj* text, int start, int length) {
+    if (length < SLICE_MIN_LENGTH)
+        return (Obj*)new_string(flat_chars(text) + start, length);
+
+    // A slice of a slice shares the characters of the same parent.
+    ObjString* parent = (ObjString*)text;
+    if (text->type == OBJ_SLICE) {
+        ObjSlice* outer = (ObjSlice*)text;
+        parent = DEREF(ObjString, outer->parent);
+        start += outer->start;
+    }
+    if (start == 0 && length == parent->length)
+        return (Obj*)parent;
+
+    ObjSlice* slice = ALLOCATE_OBJ(ObjSlice, OBJ_SLICE);
+    slice->length = length;
+    slice->start = start;
+    slice->parent = TO_REF(parent);
+    return (Obj*)slice;
+}
+
+ObjString*
+flatten_slice(ObjSlice* slice) {
+    ObjString* parent = DEREF(ObjString, slice->parent);
+    if (slice->start == 0 && slice->length == parent->length)
+        return parent;
+
+    ObjString* string = reserve_string(slice->length);
+    parent = DEREF(ObjString, slice->parent);
+    memcpy(string->chars, parent->chars + slice->start, slice->length);
+
+    overwrite_barrier(OBJ_VAL((Obj*)parent));
+    slice->parent = TO_REF(string);
+    slice->start = 0;
+    write_barrier((Obj*)slice, OBJ_VAL(string));
+    return string;
+}
+
+const char*
+object_type_name(ObjType type) {
+    switch (type) {
+        case OBJ_FUNCTION:
+            return "function";
+        case OBJ_UPVALUE:
+            return "upvalue";
+        case OBJ_CLOSURE:
+            return "closure";
+        case OBJ_NATIVE:
+            return "native";
+        case OBJ_STRING:
+            return "string";
+        case OBJ_CLASS:
+            return "class";
+        case OBJ_INSTANCE:
+            return "instance";
+        case OBJ_BOUND_METHOD:
+            return "bound_method";
+        case OBJ_WEAK_REF:
+            return "weak_ref";
+        case OBJ_WEAK_MAP:
+            return "weak_map";
+        case OBJ_ROPE:
+            return "rope";
+        case OBJ_SLICE:
+            return "slice";
+    }
+    return "unknown";
 }
 
 void
 print_object(Value value) {
     switch (OBJ_TYPE(value)) {
         case OBJ_STRING:
-            printf("%s", AS_CSTRING(value));
+            output_write(AS_CSTRING(value), (size_t)AS_STRING(value)->length);
             break;
         case OBJ_FUNCTION:
             print_function(AS_FUNCTION(value));
             break;
         case OBJ_NATIVE:
-            printf("<native fn>");
+            output_string("<native fn>");
             break;
         case OBJ_UPVALUE:
-            printf("upvalue");
+            output_string("upvalue");
             break;
         case OBJ_CLOSURE:
-            print_function(AS_CLOSURE(value)->function);
+            print_function(DEREF(ObjFunction, AS_CLOSURE(value)->function));
             break;
         case OBJ_CLASS:
-            printf("%s", AS_CLASS(value)->name->chars);
+            output_string(DEREF(ObjString, AS_CLASS(value)->name)->chars);
             break;
         case OBJ_INSTANCE:
-            printf("%s instance", AS_INSTANCE(value)->klass->name->chars);
+            output_format(
+                "%s instance",
+                DEREF(
+                    ObjString,
+                    DEREF(ObjClass, AS_INSTANCE(value)->klass)->name)
+                    ->chars);
             break;
         case OBJ_BOUND_METHOD:
-            print_function(AS_BOUND_METHOD(value)->method->function);
+            print_function(DEREF(
+                ObjFunction,
+                DEREF(ObjClosure, AS_BOUND_METHOD(value)->method)->function));
+            break;
+        case OBJ_WEAK_REF:
+            output_string("<weak ref>");
+            break;
+        case OBJ_WEAK_MAP:
+            output_string("<weak map>");
+            break;
+        case OBJ_ROPE: {
+            ObjString* flat = flatten_rope(AS_ROPE(value));
+            output_write(flat->chars, (size_t)flat->length);
+            break;
+        }
+        case OBJ_SLICE:
+            output_write(
+                flat_chars(AS_OBJ(value)), (size_t)AS_SLICE(value)->length);
             break;
     }
 }
@@ -155,7 +381,7 @@ print_object(Value value) {
 ObjClass*
 new_class(ObjString* name) {
     ObjClass* klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
-    klass->name = name;
+    klass->name = TO_REF(name);
     init_hashmap(&klass->methods);
     return klass;
 }
@@ -163,7 +389,7 @@ new_class(ObjString* name) {
 ObjInstance*
 new_instance(ObjClass* klass) {
     ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
-    instance->klass = klass;
+    instance->klass = TO_REF(klass);
     init_hashmap(&instance->fields);
     return instance;
 }
@@ -172,6 +398,24 @@ ObjBoundMethod*
 new_bound_method(Value receiver, ObjClosure* method) {
     ObjBoundMethod* bound = ALLOCATE_OBJ(ObjBoundMethod, OBJ_BOUND_METHOD);
     bound->receiver = receiver;
-    bound->method = method;
+    bound->method = TO_REF(method);
     return bound;
-}
\ No newline at end of file
+}
+
+ObjWeakRef*
+new_weak_ref(Value target) {
+    ObjWeakRef* ref = ALLOCATE_OBJ(ObjWeakRef, OBJ_WEAK_REF);
+    ref->target = target;
+    ref->next_weak = TO_REF(vm.weak_refs);
+    vm.weak_refs = ref;
+    return ref;
+}
+
+ObjWeakMap*
+new_weak_map(void) {
+    ObjWeakMap* map = ALLOCATE_OBJ(ObjWeakMap, OBJ_WEAK_MAP);
+    init_weak_table(&map->table);
+    map->next_weak = TO_REF(vm.weak_maps);
+    vm.weak_maps = map;
+    return map;
+}
@@ -6,8 +6,10 @@
 #pragma once
 
 #include "bytecode.h"
+#include "cage.h"
 #include "hash_map.h"
 #include "value.h"
+#include "weak_table.h"
 #include <stdint.h>
 
 // Get the type of the object.
@@ -16,6 +18,19 @@
 // Determine if the object is a string.
 #define IS_STRING(value) is_obj_type(value, OBJ_STRING)
 
+// Determine if the object is a rope, a string that is not flattened yet.
+#define IS_ROPE(value) is_obj_type(value, OBJ_ROPE)
+
+// Determine if the object is a slice, a string that shares the characters
+// of another.
+#define IS_SLICE(value) is_obj_type(value, OBJ_SLICE)
+
+// Determine if the object is a string whose characters are in one place.
+#define IS_FLAT_STRING(value) (IS_STRING(value) || IS_SLICE(value))
+
+// Determine if the object is a string in any of its forms.
+#define IS_ANY_STRING(value) (IS_FLAT_STRING(value) || IS_ROPE(value))
+
 // Determine if the object is a function
 #define IS_FUNCTION(value) is_obj_type(value, OBJ_FUNCTION)
 
@@ -34,9 +49,21 @@
 // Determine if the object is a bound method.
 #define IS_BOUND_METHOD(value) is_obj_type(value, OBJ_BOUND_METHOD)
 
+// Determine if the object is a weak reference.
+#define IS_WEAK_REF(value) is_obj_type(value, OBJ_WEAK_REF)
+
+// Determine if the object is a weak map.
+#define IS_WEAK_MAP(value) is_obj_type(value, OBJ_WEAK_MAP)
+
 // Convert the object to an ObjString type.
 #define AS_STRING(value) ((ObjString*)AS_OBJ(value))
 
+// Convert the object to a rope.
+#define AS_ROPE(value) ((ObjRope*)AS_OBJ(value))
+
+// Convert the object to a slice.
+#define AS_SLICE(value) ((ObjSlice*)AS_OBJ(value))
+
 // Convert the object to an ObjFunction type.
 #define AS_FUNCTION(value) ((ObjFunction*)AS_OBJ(value))
 
@@ -58,6 +85,12 @@
 // Convert the object to a bound method.
 #define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
 
+// Convert the object to a weak reference.
+#define AS_WEAK_REF(value) ((ObjWeakRef*)AS_OBJ(value))
+
+// Convert the object to a weak map.
+#define AS_WEAK_MAP(value) ((ObjWeakMap*)AS_OBJ(value))
+
 /// A tag to identify the different types of objects supported
 /// in the language.
 typedef enum {
@@ -69,22 +102,36 @@ typedef enum {
     OBJ_CLASS,        // A class.
     OBJ_INSTANCE,     // A class instance.
     OBJ_BOUND_METHOD, // A method bound to a class instance.
+    OBJ_WEAK_REF,     // A reference that does not keep its target alive.
+    OBJ_WEAK_MAP,     // A map that does not keep its keys alive.
+    OBJ_ROPE,         // The concatenation of two strings.
+    OBJ_SLICE,        // Characters that belong to another string.
 } ObjType;
 
-/// An object instance.
+// The number of object types.
+#define OBJ_TYPE_COUNT (OBJ_SLICE + 1)
+
+// The shortest string that concatenation builds as a rope. Shorter ones are
+// copied right away, which is cheaper than a rope node and its flattening.
+#define ROPE_MIN_LENGTH 64
+
+// The shortest literal or substring made a slice. Shorter ones are copied,
+// which takes no more memory than a slice and keeps nothing else alive.
+#define SLICE_MIN_LENGTH 16
+
+/// An object instance. The header only holds the type: mark bits live in
+/// the page bitmaps, and the gc finds objects through their pages.
 struct Obj {
-    ObjType type;      // The type of the object.
-    bool    is_marked; // When true, marked as reachable by gc.
-    Obj*    next;      // An intrusive list. pointer to the next object.
+    ObjType type; // The type of the object.
 };
 
 /// A function that can be called.
 typedef struct {
-    Obj        obj;           // The object header.
-    int        arity;         // The number of function parameters.
-    int        upvalue_count; // The number of upvalues.
-    Bytecode   bytecode;      // The bytecode for the function body.
-    ObjString* name;          // The function name.
+    Obj            obj;           // The object header.
+    int            arity;         // The number of function parameters.
+    int            upvalue_count; // The number of upvalues.
+    REF(ObjString) name;          // The function name.
+    Bytecode       bytecode;      // The bytecode for the function body.
 } ObjFunction;
 
 /// A native C function.
@@ -103,51 +150,95 @@ typedef struct {
     NativeFn function; // The C function pointer.
 } ObjNative;
 
-/// A string representation.
+/// A string representation. The characters are stored in the same
+/// allocation, right after the header. Only strings that are interned have
+/// their hash computed: the others are never used as keys.
 struct ObjString {
-    Obj      obj;    // The object header.
-    int      length; // The number of characters
-    char*    chars;  // The pointer to the string contents.
-    uint32_t hash;   // The precomputed hash for the string.
+    Obj      obj;      // The object header.
+    int      length;   // The number of characters
+    uint32_t hash;     // The hash of the characters, once interned.
+    bool     interned; // True when the string is the one in vm.strings.
+    char     chars[];  // The string contents, followed by a terminator.
 };
 
+/// A string made by concatenation, whose characters are not copied until
+/// they are needed. The halves are strings or ropes themselves. Flattening
+/// copies the characters into a new string, which is not interned until it
+/// is used as a key. The string replaces the left half, and the right half
+/// is dropped.
+typedef struct {
+    Obj      obj;    // The object header.
+    int      length; // The number of characters.
+    REF(Obj) left;   // The first half, or the flat string once flattened.
+    REF(Obj) right;  // The second half, or NULL once flattened.
+} ObjRope;
+
+/// A string made of characters that belong to another string, such as a
+/// literal in the source or a substring, which are not copied until they
+/// are needed as a string of their own, such as for a key. The slice keeps
+/// its parent alive until then. Flattening copies the characters into a
+/// string that becomes the whole of the parent, so the old parent can go.
+typedef struct {
+    Obj            obj;    // The object header.
+    int            length; // The number of characters.
+    int            start;  // Where the characters start in the parent.
+    REF(ObjString) parent; // The string the characters belong to.
+} ObjSlice;
+
 /// A runtime upvalue.
 typedef struct ObjUpvalue {
-    Obj    obj;              // The object header.
-    Value* location;         // The location of the upvalue.
-    Value  closed;           // The location of the closed upvalue when non-nil.
-    struct ObjUpvalue* next; // The next upvalue.
+    Obj                    obj;      // The object header.
+    REF(struct ObjUpvalue) next;     // The next upvalue.
+    Value*                 location; // The location of the upvalue.
+    Value                  closed;   // The closed upvalue when non-nil.
 } ObjUpvalue;
 
-/// A function closure.
+/// A function closure. The upvalues are stored in the same allocation.
 typedef struct {
-    Obj          obj;           // The object header.
-    ObjFunction* function;      // The function.
-    ObjUpvalue** upvalues;      // Upvalues.
-    int          upvalue_count; // The number of upvalues.
+    Obj              obj;           // The object header.
+    int              upvalue_count; // The number of upvalues.
+    REF(ObjFunction) function;      // The function.
+    REF(ObjUpvalue)  upvalues[];    // Upvalues.
 } ObjClosure;
 
 /// A class definition.
 typedef struct {
-    Obj        obj;     // The object header.
-    ObjString* name;    // The class name.
-    HashMap    methods; // A collection of methods.
+    Obj            obj;     // The object header.
+    REF(ObjString) name;    // The class name.
+    HashMap        methods; // A collection of methods.
 } ObjClass;
 
 /// An instance of a class.
 typedef struct {
-    Obj       obj;    // The object header.
-    ObjClass* klass;  // The class type.
-    HashMap   fields; // A collection of fields and values.
+    Obj           obj;    // The object header.
+    REF(ObjClass) klass;  // The class type.
+    HashMap       fields; // A collection of fields and values.
 } ObjInstance;
 
 /// A method that is bound to an instance of a class.
 typedef struct {
-    Obj         obj;      // The object header.
-    Value       receiver; // An ObjInstance typed as Value.
-    ObjClosure* method;   // The method to call.
+    Obj             obj;      // The object header.
+    REF(ObjClosure) method;   // The method to call.
+    Value           receiver; // An ObjInstance typed as Value.
 } ObjBoundMethod;
 
+/// A reference that does not keep its target alive. Once the target is
+/// collected, the reference holds nil.
+typedef struct ObjWeakRef {
+    Obj                    obj;       // The object header.
+    REF(struct ObjWeakRef) next_weak; // The next weak reference in the vm.
+    Value                  target;    // The object referred to, or nil.
+} ObjWeakRef;
+
+/// A map from objects to values that does not keep its keys alive. An
+/// entry is dropped once its key is collected, and keeps its value alive
+/// only while its key is reachable from somewhere else.
+typedef struct ObjWeakMap {
+    Obj                    obj;       // The object header.
+    REF(struct ObjWeakMap) next_weak; // The next weak map in the vm.
+    WeakTable              table;     // The entries of the map.
+} ObjWeakMap;
+
 /// Create a new function.
 ///
 /// Returns:
@@ -175,7 +266,8 @@ new_native(NativeFn function);
 ObjClosure*
 new_closure(ObjFunction* function);
 
-/// Create a deep copy of the string.
+/// Create an interned copy of the characters, or find the interned string
+/// that has them.
 ///
 /// Params:
 /// - chars: The pointer to the start of the string.
@@ -186,6 +278,65 @@ new_closure(ObjFunction* function);
 ObjString*
 copy_string(const char* chars, int length);
 
+/// Create a copy of the characters that is not interned.
+///
+/// Params:
+/// - chars: The pointer to the start of the string.
+/// - length: The count of characters in the string.
+///
+/// Returns:
+/// - ObjString*: A pointer to the newly allocated string object.
+ObjString*
+new_string(const char* chars, int length);
+
+/// Concatenate two strings. Long results are made ropes, and short ones are
+/// copied. Both strings must be reachable by the gc.
+///
+/// Params:
+/// - a: The first string or rope.
+/// - b: The second string or rope.
+///
+/// Returns:
+/// - Obj*: The concatenation, a string or a rope.
+Obj*
+concatenate_strings(Obj* a, Obj* b);
+
+/// Copy the characters of a rope into a string, which the rope keeps from
+/// then on. The rope must be reachable by the gc.
+///
+/// Params:
+/// - rope: The rope to flatten.
+///
+/// Returns:
+/// - ObjString*: The flat string.
+ObjString*
+flatten_rope(ObjRope* rope);
+
+/// Make a string of some of the characters of a string or a slice. Long
+/// results are made slices of the string that holds the characters, and
+/// short ones are copied. The text must be reachable by the gc.
+///
+/// Params:
+/// - text: The string or slice.
+/// - start: The index of the first character.
+/// - length: The number of characters, which must all be in the text.
+///
+/// Returns:
+/// - Obj*: The substring, a string or a slice.
+Obj*
+new_slice(Obj* text, int start, int length);
+
+/// Copy the characters of a slice into a string, which the slice refers to
+/// from then on. The slice must be reachable by the gc.
+///
+/// Params:
+/// - slice: The slice to flatten.
+///
+/// Returns:
+/// - ObjString*: The flat string.
+ObjString*
+flatten_slice(ObjSlice* slice);
+
 /// Create a new upvalue.
 ///
 /// Params:
@@ -196,6 +347,16 @@ copy_string(const char* chars, int length);
 ObjUpvalue*
 new_upvalue(Value* slot);
 
+/// Get the name of an object type, such as "string".
+///
+/// Params:
+/// - type: The object type.
+///
+/// Returns:
+/// - const char*: The name of the type.
+const char*
+object_type_name(ObjType type);
+
 /// Print the object to stdout.
 ///
 /// Params:
@@ -203,16 +364,29 @@ new_upvalue(Value* slot);
 void
 print_object(Value value);
 
-/// Take ownership of the string.
+/// Allocate a string whose characters the caller writes in place. The
+/// string is not interned, so it is neither hashed nor added to vm.strings
+/// unless it is passed to intern_string.
 ///
 /// Params:
-/// - chars: The pointer to the start of the string.
 /// - length: The count of characters in the string.
 ///
 /// Returns:
-/// - ObjString*: The owned string pointer.
+/// - ObjString*: The string, with only its terminator written.
+ObjString*
+reserve_string(int length);
+
+/// Get the interned string with the same characters as a string, which
+/// becomes the interned one when there is none yet. Strings must be
+/// interned before they are used as keys.
+///
+/// Params:
+/// - string: The string with its characters written.
+///
+/// Returns:
+/// - ObjString*: The interned string.
 ObjString*
-take_string(char* chars, int length);
+intern_string(ObjString* string);
 
 /// Create a new class definition.
 ///
@@ -246,6 +420,25 @@ new_instance(ObjClass* klass);
 ObjBoundMethod*
 new_bound_method(Value receiver, ObjClosure* method);
 
+/// Create a new weak reference. It is added to the weak references of the
+/// vm, which the gc clears.
+///
+/// Params:
+/// - target: The value to refer to. Only an object target is held weakly.
+///
+/// Returns:
+/// - ObjWeakRef*: The pointer to the weak reference.
+ObjWeakRef*
+new_weak_ref(Value target);
+
+/// Create a new, empty weak map. It is added to the weak maps of the vm,
+/// which the gc clears.
+///
+/// Returns:
+/// - ObjWeakMap*: The pointer to the weak map.
+ObjWeakMap*
+new_weak_map(void);
+
 /// Check to see if the value is of the given object type.
 ///
 /// Params:
@@ -258,3 +451,34 @@ static inline bool
 is_obj_type(Value value, ObjType type) {
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
+
+/// Get the characters of a string or a slice, which are not terminated in
+/// the case of a slice.
+///
+/// Params:
+/// - object: The string or slice.
+///
+/// Returns:
+/// - const char*: The first character.
+static inline const char*
+flat_chars(const Obj* object) {
+    if (object->type == OBJ_SLICE) {
+        const ObjSlice* slice = (const ObjSlice*)object;
+        return DEREF(ObjString, slice->parent)->chars + slice->start;
+    }
+    return ((const ObjString*)object)->chars;
+}
+
+/// Get the number of characters of a string or a slice.
+///
+/// Params:
+/// - object: The string or slice.
+///
+/// Returns:
+/// - int: The number of characters.
+static inline int
+flat_length(const Obj* object) {
+    if (object->type == OBJ_SLICE)
+        return ((const ObjSlice*)object)->length;
+    return ((const ObjString*)object)->length;
+}
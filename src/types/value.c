@@ -5,9 +5,10 @@
 
 #include "value.h"
 #include "memory.h"
+#include "number.h"
 #include "object.h"
-#include <math.h>
-#include <stdio.h>
+#include "output.h"
+#include <stdatomic.h>
 #include <string.h>
 
 void
@@ -27,6 +28,8 @@ write_value_array(ValueArray* array, Value value) {
     }
 
     array->values[array->count] = value;
+    // Publish the value before the count for a concurrent marker.
+    atomic_thread_fence(memory_order_release);
     array->count++;
 }
 
@@ -36,32 +39,37 @@ free_value_array(ValueArray* array) {
     init_value_array(array);
 }
 
+/// Print a number without making a string object for it.
+static void
+print_number(double value) {
+    char buffer[NUMBER_BUFFER_SIZE];
+    int  length = format_number(value, buffer);
+    output_write(buffer, (size_t)length);
+}
+
 void
 print_value(Value value) {
 #ifdef NAN_BOXING
     if (IS_BOOL(value)) {
-        printf(AS_BOOL(value) ? "true" : "false");
+        output_string(AS_BOOL(value) ? "true" : "false");
     } else if (IS_NIL(value)) {
-        printf("nil");
+        output_string("nil");
     } else if (IS_NUMBER(value)) {
-        ObjString* str = number_to_string(AS_NUMBER(value));
-        printf("%s", str->chars);
+        print_number(AS_NUMBER(value));
     } else if (IS_OBJ(value)) {
         print_object(value);
     }
 #else
     switch (value.type) {
         case VAL_BOOL:
-            printf(AS_BOOL(value) ? "true" : "false");
+            output_string(AS_BOOL(value) ? "true" : "false");
             break;
         case VAL_NIL:
-            printf("nil");
+            output_string("nil");
             break;
-        case VAL_NUMBER: {
-            ObjString* str = number_to_string(AS_NUMBER(value));
-            printf("%s", str->chars);
+        case VAL_NUMBER:
+            print_number(AS_NUMBER(value));
             break;
-        }
         case VAL_OBJ:
             print_object(value);
             break;
@@ -69,13 +77,30 @@ print_value(Value value) {
 #endif
 }
 
+/// Compare two distinct strings or slices. Interned strings with the same
+/// contents are the same string, so only strings that are not interned are
+/// compared character by character.
+static bool
+strings_equal(const Obj* a, const Obj* b) {
+    if (a->type == OBJ_STRING && b->type == OBJ_STRING
+        && ((const ObjString*)a)->interned && ((const ObjString*)b)->interned)
+        return false;
+
+    int length = flat_length(a);
+    return length == flat_length(b)
+           && memcmp(flat_chars(a), flat_chars(b), length) == 0;
+}
+
 bool
 values_equal(Value a, Value b) {
 #ifdef NAN_BOXING
     if (IS_NUMBER(a) && IS_NUMBER(b)) {
         return AS_NUMBER(a) == AS_NUMBER(b);
     }
-    return a == b;
+    if (a == b)
+        return true;
+    return IS_FLAT_STRING(a) && IS_FLAT_STRING(b)
+           && strings_equal(AS_OBJ(a), AS_OBJ(b));
 #else
     if (a.type != b.type)
         return false;
@@ -87,7 +112,10 @@ values_equal(Value a, Value b) {
         case VAL_NUMBER:
             return AS_NUMBER(a) == AS_NUMBER(b);
         case VAL_OBJ: {
-            return AS_OBJ(a) == AS_OBJ(b);
+            if (AS_OBJ(a) == AS_OBJ(b))
+                return true;
+            return IS_FLAT_STRING(a) && IS_FLAT_STRING(b)
+                   && strings_equal(AS_OBJ(a), AS_OBJ(b));
         }
         default:
             return false; // Unreachable.
@@ -97,131 +125,7 @@ values_equal(Value a, Value b) {
 
 ObjString*
 number_to_string(double value) {
-    // Handle special cases
-    if (isnan(value)) {
-        return copy_string("nan", 3);
-    }
-    if (isinf(value)) {
-        return copy_string(value > 0 ? "inf" : "-inf", value > 0 ? 3 : 4);
-    }
-
-    // Handle zero
-    if (value == 0.0) {
-        return copy_string("0", 1);
-    }
-
-    // Handle negative numbers
-    int is_negative = value < 0;
-    if (is_negative) {
-        value = -value;
-    }
-
-    // Separate integer and fractional parts
-    long long integer_part = (long long)value;
-    double    fractional_part = value - integer_part;
-
-    // Count digits in integer part
-    long long temp = integer_part;
-    int       integer_digits = 0;
-    if (integer_part == 0) {
-        integer_digits = 1;
-    } else {
-        while (temp > 0) {
-            integer_digits++;
-            temp /= 10;
-        }
-    }
-
-    // Add commas to integer part (every 3 digits from right)
-    int comma_count = (integer_digits - 1) / 3;
-    int total_integer_chars =
-        integer_digits + comma_count + (is_negative ? 1 : 0);
-
-    // Handle fractional part
-    char fractional_buf[32] = {0};
-    int  fractional_digits = 0;
-
-    if (fractional_part > 1e-10) {
-        // Convert to string with maximum precision
-        char temp_buf[32];
-        snprintf(temp_buf, sizeof(temp_buf), "%.15f", fractional_part);
-
-        // Extract fractional part (skip "0.")
-        if (strlen(temp_buf) >= 2 && temp_buf[0] == '0' && temp_buf[1] == '.') {
-            char* frac_start = temp_buf + 2;
-            int   len = strlen(frac_start);
-
-            // Remove trailing zeros
-            while (len > 0 && frac_start[len - 1] == '0') {
-                len--;
-            }
-
-            if (len > 0) {
-                fractional_digits = len;
-                strncpy(fractional_buf, frac_start, len);
-                fractional_buf[len] = '\0';
-            }
-        }
-    }
-
-    // Calculate total length
-    int total_length = total_integer_chars;
-    if (fractional_digits > 0) {
-        total_length += 1 + fractional_digits; // +1 for decimal point
-    }
-
-    // Allocate buffer for the result
-    char* result_buf = ALLOCATE(char, total_length + 1);
-    if (!result_buf) {
-        return NULL;
-    }
-
-    int pos = 0;
-
-    // Add negative sign if needed
-    if (is_negative) {
-        result_buf[pos++] = '-';
-    }
-
-    // Convert integer part to string with commas (fixed logic)
-    if (integer_part == 0) {
-        result_buf[pos++] = '0';
-    } else {
-        char integer_buf[32];
-        snprintf(integer_buf, sizeof(integer_buf), "%lld", integer_part);
-
-        int len = strlen(integer_buf);
-
-        // Calculate where commas should be placed
-        int first_group_size = len % 3;
-        if (first_group_size == 0) {
-            first_group_size = 3;
-        }
-
-        // Add first group of digits
-        for (int i = 0; i < first_group_size; i++) {
-            result_buf[pos++] = integer_buf[i];
-        }
-
-        // Add remaining groups with commas
-        for (int i = first_group_size; i < len; i += 3) {
-            result_buf[pos++] = ',';
-            for (int j = 0; j < 3 && (i + j) < len; j++) {
-                result_buf[pos++] = integer_buf[i + j];
-            }
-        }
-    }
-
-    // Add fractional part if needed
-    if (fractional_digits > 0) {
-        result_buf[pos++] = '.';
-        strcpy(result_buf + pos, fractional_buf);
-        pos += fractional_digits;
-    }
-
-    result_buf[pos] = '\0';
-
-    // Create ObjString from the buffer
-    ObjString* result_str = take_string(result_buf, pos);
-    return result_str;
-}
\ No newline at end of file
+    char buffer[NUMBER_BUFFER_SIZE];
+    int  length = format_number(value, buffer);
+    return new_string(buffer, length);
+}
@@ -151,5 +151,13 @@ free_value_array(ValueArray* array);
 void
 print_value(Value value);
 
+/// Convert a number to a string as format_number writes it. The string is
+/// not interned.
+///
+/// Params:
+/// - value: The number to convert.
+///
+/// Returns:
+/// - ObjString*: The new string.
 ObjString*
 number_to_string(double value);
\ No newline at end of file
@@ -0,0 +1,196 @@
+// File:    weak_table.c
+// Purpose: Implement weak_table.h
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#include "weak_table.h"
+#include "memory.h"
+#include "object.h"
+#include "value.h"
+#include <string.h>
+
+#define TABLE_MAX_LOAD 0.75
+
+void
+init_weak_table(WeakTable* table) {
+    table->count = 0;
+    table->capacity = 0;
+    table->entries = NULL;
+}
+
+void
+free_weak_table(WeakTable* table) {
+    FREE_ARRAY(WeakEntry, table->entries, table->capacity);
+    init_weak_table(table);
+}
+
+static uint32_t
+hash_key(const Obj* key) {
+    // Slots are at least 16 bytes apart, so the low bits carry nothing.
+    uint64_t address = (uint64_t)(uintptr_t)key >> 4;
+    return (uint32_t)(address ^ (address >> 32)) * 2654435769u;
+}
+
+static WeakEntry*
+find_entry(WeakEntry* entries, int capacity, const Obj* key) {
+    uint32_t   index = hash_key(key) & (capacity - 1);
+    WeakEntry* tombstone = NULL;
+
+    for (;;) {
+        WeakEntry* entry = &entries[index];
+        if (entry->key == NULL) {
+            if (IS_NIL(entry->value)) {
+                // Empty entry.
+                return tombstone != NULL ? tombstone : entry;
+            } else if (tombstone == NULL) {
+                tombstone = entry;
+            }
+        } else if (entry->key == key) {
+            return entry;
+        }
+
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+/// Place the live entries of an array into the table's entries, which must
+/// be empty.
+static void
+place_entries(WeakTable* table, const WeakEntry* entries, int capacity) {
+    table->count = 0;
+    for (int i = 0; i < capacity; i++) {
+        const WeakEntry* entry = &entries[i];
+        if (entry->key == NULL)
+            continue;
+
+        WeakEntry* dest =
+            find_entry(table->entries, table->capacity, entry->key);
+        dest->key = entry->key;
+        dest->value = entry->value;
+        table->count++;
+    }
+}
+
+static void
+clear_entries(WeakEntry* entries, int capacity) {
+    for (int i = 0; i < capacity; i++) {
+        entries[i].key = NULL;
+        entries[i].value = NIL_VAL;
+    }
+}
+
+static void
+adjust_capacity(WeakTable* table, int capacity) {
+    WeakEntry* new_entries = ALLOCATE(WeakEntry, capacity);
+    clear_entries(new_entries, capacity);
+
+    WeakEntry* old_entries = table->entries;
+    int        old_capacity = table->capacity;
+    table->entries = new_entries;
+    table->capacity = capacity;
+    place_entries(table, old_entries, old_capacity);
+    FREE_ARRAY(WeakEntry, old_entries, old_capacity);
+}
+
+static int
+count_live(const WeakTable* table) {
+    int live = 0;
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key != NULL)
+            live++;
+    }
+    return live;
+}
+
+bool
+weak_table_set(WeakTable* table, Obj* key, Value value) {
+    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
+        // Collected keys leave tombstones that count towards the load, so
+        // the table is only grown when its live entries need the room.
+        int capacity = table->capacity;
+        if (count_live(table) + 1 > capacity / 2) {
+            capacity = GROW_CAPACITY(capacity);
+        }
+        adjust_capacity(table, capacity);
+    }
+
+    WeakEntry* entry = find_entry(table->entries, table->capacity, key);
+    bool       is_new = entry->key == NULL;
+    if (is_new && IS_NIL(entry->value))
+        table->count++;
+
+    entry->key = key;
+    entry->value = value;
+    return is_new;
+}
+
+bool
+weak_table_get(WeakTable* table, Obj* key, Value* value) {
+    if (table->count == 0)
+        return false;
+
+    const WeakEntry* entry = find_entry(table->entries, table->capacity, key);
+    if (entry->key == NULL)
+        return false;
+
+    *value = entry->value;
+    return true;
+}
+
+bool
+weak_table_delete(WeakTable* table, Obj* key) {
+    if (table->count == 0)
+        return false;
+
+    WeakEntry* entry = find_entry(table->entries, table->capacity, key);
+    if (entry->key == NULL)
+        return false;
+
+    entry->key = NULL;
+    entry->value = BOOL_VAL(true);
+    return true;
+}
+
+bool
+weak_table_mark_values(WeakTable* table) {
+    bool marked = false;
+    for (int i = 0; i < table->capacity; i++) {
+        WeakEntry* entry = &table->entries[i];
+        if (entry->key == NULL || !is_object_marked(entry->key))
+            continue;
+
+        Value value = entry->value;
+        if (IS_OBJ(value) && !is_object_marked(AS_OBJ(value))) {
+            mark_object(AS_OBJ(value));
+            marked = true;
+        }
+    }
+    return marked;
+}
+
+void
+weak_table_remove_white(WeakTable* table) {
+    for (int i = 0; i < table->capacity; i++) {
+        WeakEntry* entry = &table->entries[i];
+        if (entry->key != NULL && !is_object_marked(entry->key)) {
+            entry->key = NULL;
+            entry->value = BOOL_VAL(true);
+        }
+    }
+}
+
+void
+forward_weak_table(WeakTable* table, WeakEntry* scratch) {
+    if (table->count == 0)
+        return;
+
+    memcpy(scratch, table->entries, sizeof(WeakEntry) * table->capacity);
+    for (int i = 0; i < table->capacity; i++) {
+        WeakEntry* entry = &scratch[i];
+        entry->key = forward_object(entry->key);
+        entry->value = forward_value(entry->value);
+    }
+
+    clear_entries(table->entries, table->capacity);
+    place_entries(table, scratch, table->capacity);
+}
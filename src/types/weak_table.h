@@ -0,0 +1,101 @@
+// File:    weak_table.h
+// Purpose: Definitions for a hash table whose keys are held weakly.
+// Author:  Jake Hathaway
+// Date:    2026-10-18
+
+#pragma once
+
+#include "common.h"
+#include "value.h"
+
+/// An entry in a weak table. Keys are compared by identity.
+typedef struct {
+    Obj*  key;   // The key, or NULL for an empty entry or a tombstone.
+    Value value; // The value, or true for a tombstone.
+} WeakEntry;
+
+/// A hash table that does not keep its keys alive. An entry keeps its value
+/// alive only while its key is reachable from somewhere else, which makes
+/// each entry an ephemeron.
+typedef struct {
+    int        count;    // The number of entries, tombstones included.
+    int        capacity; // The total number of entries allowed.
+    WeakEntry* entries;  // The start of the entries.
+} WeakTable;
+
+/// Initialize a new weak table.
+///
+/// Params:
+/// - table: The weak table to initialize.
+void
+init_weak_table(WeakTable* table);
+
+/// Free the resources for the weak table.
+///
+/// Params:
+/// - table: The weak table to free the resources for.
+void
+free_weak_table(WeakTable* table);
+
+/// Add or update the value associated with the given key.
+///
+/// Params:
+/// - table: The weak table to update.
+/// - key: The key for the entry.
+/// - value: The value to store with the key.
+///
+/// Returns:
+/// - bool: True if and only if a new entry was added, otherwise false.
+bool
+weak_table_set(WeakTable* table, Obj* key, Value value);
+
+/// Get the value associated with the given key.
+///
+/// Params:
+/// - table: The weak table to get the value from.
+/// - key: The key to use to search for the value.
+/// - value: An output parameter that will hold the value if found.
+///
+/// Returns:
+/// - bool: True if the value was found, otherwise false.
+bool
+weak_table_get(WeakTable* table, Obj* key, Value* value);
+
+/// Delete the entry with the given key.
+///
+/// Params:
+/// - table: The weak table to delete the entry from.
+/// - key: The key used to find the entry to delete.
+///
+/// Returns:
+/// - bool: True when the entry was found and deleted, otherwise false.
+bool
+weak_table_delete(WeakTable* table, Obj* key);
+
+/// Mark the values of the entries whose keys are marked.
+///
+/// Params:
+/// - table: The weak table which contains values to mark.
+///
+/// Returns:
+/// - bool: True when a value that was not marked yet got marked.
+bool
+weak_table_mark_values(WeakTable* table);
+
+/// Remove the entries whose keys are not marked.
+///
+/// Params:
+/// - table: The weak table to remove the entries from.
+void
+weak_table_remove_white(WeakTable* table);
+
+/// Update the keys and values to the addresses of objects that a compaction
+/// moved. Keys are hashed by address, so the entries are placed again.
+///
+/// Params:
+/// - table: The weak table which contains references to update.
+/// - scratch: Room to copy the entries aside, at least the capacity of the
+///   table. Nothing can be allocated in the middle of a compaction, so the
+///   gc reserves it before anything moves.
+void
+forward_weak_table(WeakTable* table, WeakEntry* scratch);